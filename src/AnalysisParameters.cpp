@@ -5,6 +5,7 @@ AnalysisParameters::AnalysisParameters()
       numberOfSteps_(1),
       maxNonlinearIterations_(3),
       nonlinearTolerance_(1.0e-6),
+      errorTolerance_(0.0),
       integrationMethod_(0.5),
       deltat_(1.0),
       initialDeltat_(1.0),
@@ -21,7 +22,36 @@ AnalysisParameters::AnalysisParameters()
       exportFrequency_(1),
       initialAccel_(false),
       isStaticAnalysis_(false),
-      useLumpedMass_(true) {}
+      useLumpedMass_(true),
+      numberOfThreads_(1),
+      referenceGeometryCache_(false),
+      modifiedNewton_(false),
+      maxFactorizationReuses_(10),
+      refactorizationContraction_(0.5),
+      solverProfile_(SolverProfile::DEFAULT),
+      matrixFree_(false),
+      globalization_(Globalization::FULL_STEP),
+      maxLineSearchIterations_(10),
+      arcLength_(false),
+      initialArcLength_(0.0),
+      arcLengthIterations_(5),
+      arcLengthScaling_(0.0),
+      maxArcLengthSteps_(1000),
+      maxTimeStepGrowth_(2.0),
+      minTimeStepShrink_(0.25),
+      minDeltat_(0.0),
+      maxDeltat_(0.0),
+      explicitCourantNumber_(0.5),
+      predictor_(Predictor::PREVIOUS_STEP),
+      extrapolationSteps_(3),
+      convergenceCriterion_(ConvergenceCriterion::POSITION_INCREMENT),
+      residualTolerance_(1.0e-8),
+      paraviewFormat_(VTUFormat::APPENDED_RAW),
+      asynchronousOutput_(true),
+      outputSnapshots_(2),
+      resultsFormat_(ResultsFormat::VTU),
+      timeSeriesBufferRows_(100),
+      binaryTimeSeries_(false) {}
 
 AnalysisParameters::~AnalysisParameters() {}
 
@@ -157,6 +187,151 @@ void AnalysisParameters::setLumpedMass(const bool &useLumpedMass)
     useLumpedMass_ = useLumpedMass;
 }
 
+void AnalysisParameters::setNumberOfThreads(const int &numberOfThreads)
+{
+    numberOfThreads_ = numberOfThreads;
+}
+
+void AnalysisParameters::setReferenceGeometryCache(const bool &referenceGeometryCache)
+{
+    referenceGeometryCache_ = referenceGeometryCache;
+}
+
+void AnalysisParameters::setModifiedNewton(const bool &modifiedNewton)
+{
+    modifiedNewton_ = modifiedNewton;
+}
+
+void AnalysisParameters::setMaxFactorizationReuses(const int &maxFactorizationReuses)
+{
+    maxFactorizationReuses_ = maxFactorizationReuses;
+}
+
+void AnalysisParameters::setRefactorizationContraction(const double &refactorizationContraction)
+{
+    refactorizationContraction_ = refactorizationContraction;
+}
+
+void AnalysisParameters::setSolverProfile(const SolverProfile &solverProfile)
+{
+    solverProfile_ = solverProfile;
+}
+
+void AnalysisParameters::setMatrixFree(const bool &matrixFree)
+{
+    matrixFree_ = matrixFree;
+}
+
+void AnalysisParameters::setGlobalization(const Globalization &globalization)
+{
+    globalization_ = globalization;
+}
+
+void AnalysisParameters::setMaxLineSearchIterations(const int &maxLineSearchIterations)
+{
+    maxLineSearchIterations_ = maxLineSearchIterations;
+}
+
+void AnalysisParameters::setArcLength(const bool &arcLength)
+{
+    arcLength_ = arcLength;
+}
+
+void AnalysisParameters::setInitialArcLength(const double &initialArcLength)
+{
+    initialArcLength_ = initialArcLength;
+}
+
+void AnalysisParameters::setArcLengthIterations(const int &arcLengthIterations)
+{
+    arcLengthIterations_ = arcLengthIterations;
+}
+
+void AnalysisParameters::setArcLengthScaling(const double &arcLengthScaling)
+{
+    arcLengthScaling_ = arcLengthScaling;
+}
+
+void AnalysisParameters::setMaxArcLengthSteps(const int &maxArcLengthSteps)
+{
+    maxArcLengthSteps_ = maxArcLengthSteps;
+}
+
+void AnalysisParameters::setMaxTimeStepGrowth(const double &maxTimeStepGrowth)
+{
+    maxTimeStepGrowth_ = maxTimeStepGrowth;
+}
+
+void AnalysisParameters::setMinTimeStepShrink(const double &minTimeStepShrink)
+{
+    minTimeStepShrink_ = minTimeStepShrink;
+}
+
+void AnalysisParameters::setMinDeltat(const double &minDeltat)
+{
+    minDeltat_ = minDeltat;
+}
+
+void AnalysisParameters::setMaxDeltat(const double &maxDeltat)
+{
+    maxDeltat_ = maxDeltat;
+}
+
+void AnalysisParameters::setExplicitCourantNumber(const double &explicitCourantNumber)
+{
+    explicitCourantNumber_ = explicitCourantNumber;
+}
+
+void AnalysisParameters::setPredictor(const Predictor &predictor)
+{
+    predictor_ = predictor;
+}
+
+void AnalysisParameters::setExtrapolationSteps(const int &extrapolationSteps)
+{
+    extrapolationSteps_ = extrapolationSteps;
+}
+
+void AnalysisParameters::setConvergenceCriterion(const ConvergenceCriterion &convergenceCriterion)
+{
+    convergenceCriterion_ = convergenceCriterion;
+}
+
+void AnalysisParameters::setResidualTolerance(const double &residualTolerance)
+{
+    residualTolerance_ = residualTolerance;
+}
+
+void AnalysisParameters::setParaviewFormat(const VTUFormat &paraviewFormat)
+{
+    paraviewFormat_ = paraviewFormat;
+}
+
+void AnalysisParameters::setAsynchronousOutput(const bool &asynchronousOutput)
+{
+    asynchronousOutput_ = asynchronousOutput;
+}
+
+void AnalysisParameters::setOutputSnapshots(const int &outputSnapshots)
+{
+    outputSnapshots_ = outputSnapshots;
+}
+
+void AnalysisParameters::setResultsFormat(const ResultsFormat &resultsFormat)
+{
+    resultsFormat_ = resultsFormat;
+}
+
+void AnalysisParameters::setTimeSeriesBufferRows(const int &timeSeriesBufferRows)
+{
+    timeSeriesBufferRows_ = timeSeriesBufferRows;
+}
+
+void AnalysisParameters::setBinaryTimeSeries(const bool &binaryTimeSeries)
+{
+    binaryTimeSeries_ = binaryTimeSeries;
+}
+
 int AnalysisParameters::getDimension() const
 {
     return dimension_;
@@ -270,4 +445,149 @@ int AnalysisParameters::getExportFrequency() const
 bool AnalysisParameters::useLumpedMass() const
 {
     return useLumpedMass_;
+}
+
+int AnalysisParameters::getNumberOfThreads() const
+{
+    return numberOfThreads_;
+}
+
+bool AnalysisParameters::useReferenceGeometryCache() const
+{
+    return referenceGeometryCache_;
+}
+
+bool AnalysisParameters::useModifiedNewton() const
+{
+    return modifiedNewton_;
+}
+
+int AnalysisParameters::getMaxFactorizationReuses() const
+{
+    return maxFactorizationReuses_;
+}
+
+double AnalysisParameters::getRefactorizationContraction() const
+{
+    return refactorizationContraction_;
+}
+
+SolverProfile AnalysisParameters::getSolverProfile() const
+{
+    return solverProfile_;
+}
+
+bool AnalysisParameters::useMatrixFree() const
+{
+    return matrixFree_;
+}
+
+Globalization AnalysisParameters::getGlobalization() const
+{
+    return globalization_;
+}
+
+int AnalysisParameters::getMaxLineSearchIterations() const
+{
+    return maxLineSearchIterations_;
+}
+
+bool AnalysisParameters::useArcLength() const
+{
+    return arcLength_;
+}
+
+double AnalysisParameters::getInitialArcLength() const
+{
+    return initialArcLength_;
+}
+
+int AnalysisParameters::getArcLengthIterations() const
+{
+    return arcLengthIterations_;
+}
+
+double AnalysisParameters::getArcLengthScaling() const
+{
+    return arcLengthScaling_;
+}
+
+int AnalysisParameters::getMaxArcLengthSteps() const
+{
+    return maxArcLengthSteps_;
+}
+
+double AnalysisParameters::getMaxTimeStepGrowth() const
+{
+    return maxTimeStepGrowth_;
+}
+
+double AnalysisParameters::getMinTimeStepShrink() const
+{
+    return minTimeStepShrink_;
+}
+
+double AnalysisParameters::getMinDeltat() const
+{
+    return minDeltat_;
+}
+
+double AnalysisParameters::getMaxDeltat() const
+{
+    return maxDeltat_;
+}
+
+double AnalysisParameters::getExplicitCourantNumber() const
+{
+    return explicitCourantNumber_;
+}
+
+Predictor AnalysisParameters::getPredictor() const
+{
+    return predictor_;
+}
+
+int AnalysisParameters::getExtrapolationSteps() const
+{
+    return extrapolationSteps_;
+}
+
+ConvergenceCriterion AnalysisParameters::getConvergenceCriterion() const
+{
+    return convergenceCriterion_;
+}
+
+double AnalysisParameters::getResidualTolerance() const
+{
+    return residualTolerance_;
+}
+
+VTUFormat AnalysisParameters::getParaviewFormat() const
+{
+    return paraviewFormat_;
+}
+
+bool AnalysisParameters::useAsynchronousOutput() const
+{
+    return asynchronousOutput_;
+}
+
+int AnalysisParameters::getOutputSnapshots() const
+{
+    return outputSnapshots_;
+}
+
+ResultsFormat AnalysisParameters::getResultsFormat() const
+{
+    return resultsFormat_;
+}
+
+int AnalysisParameters::getTimeSeriesBufferRows() const
+{
+    return timeSeriesBufferRows_;
+}
+
+bool AnalysisParameters::useBinaryTimeSeries() const
+{
+    return binaryTimeSeries_;
 }
\ No newline at end of file
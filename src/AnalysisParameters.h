@@ -1,5 +1,7 @@
 #pragma once
 
+#include "mesh_interface/Enums.h"
+
 class AnalysisParameters
 {
 public:
@@ -53,6 +55,64 @@ public:
 
     void setLumpedMass(const bool &useLumpedMass);
 
+    void setNumberOfThreads(const int &numberOfThreads);
+
+    void setReferenceGeometryCache(const bool &referenceGeometryCache);
+
+    void setModifiedNewton(const bool &modifiedNewton);
+
+    void setMaxFactorizationReuses(const int &maxFactorizationReuses);
+
+    void setRefactorizationContraction(const double &refactorizationContraction);
+
+    void setSolverProfile(const SolverProfile &solverProfile);
+
+    void setMatrixFree(const bool &matrixFree);
+
+    void setGlobalization(const Globalization &globalization);
+
+    void setMaxLineSearchIterations(const int &maxLineSearchIterations);
+
+    void setArcLength(const bool &arcLength);
+
+    void setInitialArcLength(const double &initialArcLength);
+
+    void setArcLengthIterations(const int &arcLengthIterations);
+
+    void setArcLengthScaling(const double &arcLengthScaling);
+
+    void setMaxArcLengthSteps(const int &maxArcLengthSteps);
+
+    void setMaxTimeStepGrowth(const double &maxTimeStepGrowth);
+
+    void setMinTimeStepShrink(const double &minTimeStepShrink);
+
+    void setMinDeltat(const double &minDeltat);
+
+    void setMaxDeltat(const double &maxDeltat);
+
+    void setExplicitCourantNumber(const double &explicitCourantNumber);
+
+    void setPredictor(const Predictor &predictor);
+
+    void setExtrapolationSteps(const int &extrapolationSteps);
+
+    void setConvergenceCriterion(const ConvergenceCriterion &convergenceCriterion);
+
+    void setResidualTolerance(const double &residualTolerance);
+
+    void setParaviewFormat(const VTUFormat &paraviewFormat);
+
+    void setAsynchronousOutput(const bool &asynchronousOutput);
+
+    void setOutputSnapshots(const int &outputSnapshots);
+
+    void setResultsFormat(const ResultsFormat &resultsFormat);
+
+    void setTimeSeriesBufferRows(const int &timeSeriesBufferRows);
+
+    void setBinaryTimeSeries(const bool &binaryTimeSeries);
+
     int getDimension() const;
 
     int getNumberOfSteps() const;
@@ -99,6 +159,64 @@ public:
 
     bool useLumpedMass() const;
 
+    int getNumberOfThreads() const;
+
+    bool useReferenceGeometryCache() const;
+
+    bool useModifiedNewton() const;
+
+    int getMaxFactorizationReuses() const;
+
+    double getRefactorizationContraction() const;
+
+    SolverProfile getSolverProfile() const;
+
+    bool useMatrixFree() const;
+
+    Globalization getGlobalization() const;
+
+    int getMaxLineSearchIterations() const;
+
+    bool useArcLength() const;
+
+    double getInitialArcLength() const;
+
+    int getArcLengthIterations() const;
+
+    double getArcLengthScaling() const;
+
+    int getMaxArcLengthSteps() const;
+
+    double getMaxTimeStepGrowth() const;
+
+    double getMinTimeStepShrink() const;
+
+    double getMinDeltat() const;
+
+    double getMaxDeltat() const;
+
+    double getExplicitCourantNumber() const;
+
+    Predictor getPredictor() const;
+
+    int getExtrapolationSteps() const;
+
+    ConvergenceCriterion getConvergenceCriterion() const;
+
+    double getResidualTolerance() const;
+
+    VTUFormat getParaviewFormat() const;
+
+    bool useAsynchronousOutput() const;
+
+    int getOutputSnapshots() const;
+
+    ResultsFormat getResultsFormat() const;
+
+    int getTimeSeriesBufferRows() const;
+
+    bool useBinaryTimeSeries() const;
+
 private:
     int dimension_;
     int numberOfSteps_;
@@ -123,4 +241,33 @@ private:
     bool initialAccel_;
     bool isStaticAnalysis_;
     bool useLumpedMass_;
+    int numberOfThreads_;
+    bool referenceGeometryCache_;
+    bool modifiedNewton_;
+    int maxFactorizationReuses_;
+    double refactorizationContraction_;
+    SolverProfile solverProfile_;
+    bool matrixFree_;
+    Globalization globalization_;
+    int maxLineSearchIterations_;
+    bool arcLength_;
+    double initialArcLength_;
+    int arcLengthIterations_;
+    double arcLengthScaling_;
+    int maxArcLengthSteps_;
+    double maxTimeStepGrowth_;
+    double minTimeStepShrink_;
+    double minDeltat_;
+    double maxDeltat_;
+    double explicitCourantNumber_;
+    Predictor predictor_;
+    int extrapolationSteps_;
+    ConvergenceCriterion convergenceCriterion_;
+    double residualTolerance_;
+    VTUFormat paraviewFormat_;
+    bool asynchronousOutput_;
+    int outputSnapshots_;
+    ResultsFormat resultsFormat_;
+    int timeSeriesBufferRows_;
+    bool binaryTimeSeries_;
 };
\ No newline at end of file
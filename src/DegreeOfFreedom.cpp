@@ -1,178 +1,172 @@
 #include "DegreeOfFreedom.h"
 
-DegreeOfFreedom::DegreeOfFreedom(const DOFType &type, const double value)
-    : index_(0),
-      type_(type),
-      initialValue_(value),
-      currentValue_(value),
-      pastValue_(value),
-      intermediateValue_(value),
-      initialFirstTimeDerivative_(0.0),
-      currentFirstTimeDerivative_(0.0),
-      pastFirstTimeDerivative_(0.0),
-      intermediateFirstTimeDerivative_(0.0),
-      initialSecondTimeDerivative_(0.0),
-      currentSecondTimeDerivative_(0.0),
-      pastSecondTimeDerivative_(0.0),
-      intermediateSecondTimeDerivative_(0.0),
-      isConstrained_(false) {}
-
-int DegreeOfFreedom::getIndex() const
-{
-    return index_;
-}
-
-DOFType DegreeOfFreedom::getType() const
-{
-    return type_;
-}
-
-double DegreeOfFreedom::getInitialValue() const
-{
-    return initialValue_;
-}
-
-double DegreeOfFreedom::getCurrentValue() const
-{
-    return currentValue_;
-}
-
-double DegreeOfFreedom::getPastValue() const
-{
-    return pastValue_;
-}
-
-double DegreeOfFreedom::getIntermediateValue() const
-{
-    return intermediateValue_;
-}
+DegreeOfFreedomStore::DegreeOfFreedomStore() {}
 
-double DegreeOfFreedom::getInitialFirstTimeDerivative() const
-{
-    return initialFirstTimeDerivative_;
-}
-
-double DegreeOfFreedom::getCurrentFirstTimeDerivative() const
-{
-    return currentFirstTimeDerivative_;
-}
-
-double DegreeOfFreedom::getPastFirstTimeDerivative() const
-{
-    return pastFirstTimeDerivative_;
-}
+DegreeOfFreedomStore::~DegreeOfFreedomStore() {}
 
-double DegreeOfFreedom::getIntermediateFirstTimeDerivative() const
+int DegreeOfFreedomStore::addSlot(const DOFType &type, const double &value)
 {
-    return intermediateFirstTimeDerivative_;
+    index_.push_back(0);
+    type_.push_back(type);
+    initialValue_.push_back(value);
+    currentValue_.push_back(value);
+    pastValue_.push_back(value);
+    intermediateValue_.push_back(value);
+    initialFirstTimeDerivative_.push_back(0.0);
+    currentFirstTimeDerivative_.push_back(0.0);
+    pastFirstTimeDerivative_.push_back(0.0);
+    intermediateFirstTimeDerivative_.push_back(0.0);
+    initialSecondTimeDerivative_.push_back(0.0);
+    currentSecondTimeDerivative_.push_back(0.0);
+    pastSecondTimeDerivative_.push_back(0.0);
+    intermediateSecondTimeDerivative_.push_back(0.0);
+    isConstrained_.push_back(false);
+    return index_.size() - 1;
 }
 
-double DegreeOfFreedom::getInitialSecondTimeDerivative() const
+void DegreeOfFreedomStore::rebuild(const std::vector<DegreeOfFreedom *> &dofs)
 {
-    return initialSecondTimeDerivative_;
-}
+    DegreeOfFreedomStore store;
+    const int size = dofs.size();
+    for (int i = 0; i < size; i++)
+    {
+        const DegreeOfFreedom *dof = dofs[i];
+        const DegreeOfFreedomStore *old = dof->store_;
+        const int slot = dof->slot_;
+        store.index_.push_back(old->index_[slot]);
+        store.type_.push_back(old->type_[slot]);
+        store.initialValue_.push_back(old->initialValue_[slot]);
+        store.currentValue_.push_back(old->currentValue_[slot]);
+        store.pastValue_.push_back(old->pastValue_[slot]);
+        store.intermediateValue_.push_back(old->intermediateValue_[slot]);
+        store.initialFirstTimeDerivative_.push_back(old->initialFirstTimeDerivative_[slot]);
+        store.currentFirstTimeDerivative_.push_back(old->currentFirstTimeDerivative_[slot]);
+        store.pastFirstTimeDerivative_.push_back(old->pastFirstTimeDerivative_[slot]);
+        store.intermediateFirstTimeDerivative_.push_back(old->intermediateFirstTimeDerivative_[slot]);
+        store.initialSecondTimeDerivative_.push_back(old->initialSecondTimeDerivative_[slot]);
+        store.currentSecondTimeDerivative_.push_back(old->currentSecondTimeDerivative_[slot]);
+        store.pastSecondTimeDerivative_.push_back(old->pastSecondTimeDerivative_[slot]);
+        store.intermediateSecondTimeDerivative_.push_back(old->intermediateSecondTimeDerivative_[slot]);
+        store.isConstrained_.push_back(old->isConstrained_[slot]);
+    }
 
-double DegreeOfFreedom::getCurrentSecondTimeDerivative() const
-{
-    return currentSecondTimeDerivative_;
-}
+    index_.swap(store.index_);
+    type_.swap(store.type_);
+    initialValue_.swap(store.initialValue_);
+    currentValue_.swap(store.currentValue_);
+    pastValue_.swap(store.pastValue_);
+    intermediateValue_.swap(store.intermediateValue_);
+    initialFirstTimeDerivative_.swap(store.initialFirstTimeDerivative_);
+    currentFirstTimeDerivative_.swap(store.currentFirstTimeDerivative_);
+    pastFirstTimeDerivative_.swap(store.pastFirstTimeDerivative_);
+    intermediateFirstTimeDerivative_.swap(store.intermediateFirstTimeDerivative_);
+    initialSecondTimeDerivative_.swap(store.initialSecondTimeDerivative_);
+    currentSecondTimeDerivative_.swap(store.currentSecondTimeDerivative_);
+    pastSecondTimeDerivative_.swap(store.pastSecondTimeDerivative_);
+    intermediateSecondTimeDerivative_.swap(store.intermediateSecondTimeDerivative_);
+    isConstrained_.swap(store.isConstrained_);
 
-double DegreeOfFreedom::getPastSecondTimeDerivative() const
-{
-    return pastSecondTimeDerivative_;
+    for (int i = 0; i < size; i++)
+    {
+        DegreeOfFreedom *dof = dofs[i];
+        if (dof->ownsStore_)
+            delete dof->store_;
+        dof->store_ = this;
+        dof->slot_ = i;
+        dof->ownsStore_ = false;
+    }
 }
 
-double DegreeOfFreedom::getIntermediateSecondTimeDerivative() const
+int DegreeOfFreedomStore::getSize() const
 {
-    return intermediateSecondTimeDerivative_;
+    return index_.size();
 }
 
-void DegreeOfFreedom::setIndex(const int &index)
+double DegreeOfFreedomStore::getBytesPerDOF() const
 {
-    index_ = index;
+    return 12.0 * sizeof(double) + sizeof(int) + sizeof(DOFType) + sizeof(char);
 }
 
-void DegreeOfFreedom::setInitialValue(const double &value)
+const DOFType *DegreeOfFreedomStore::getTypes() const
 {
-    initialValue_ = value;
+    return type_.data();
 }
 
-void DegreeOfFreedom::setCurrentValue(const double &value)
+double *DegreeOfFreedomStore::getInitialValues()
 {
-    currentValue_ = value;
+    return initialValue_.data();
 }
 
-void DegreeOfFreedom::setPastValue(const double &value)
+double *DegreeOfFreedomStore::getCurrentValues()
 {
-    pastValue_ = value;
+    return currentValue_.data();
 }
 
-void DegreeOfFreedom::setIntermediateValue(const double &value)
+double *DegreeOfFreedomStore::getPastValues()
 {
-    intermediateValue_ = value;
+    return pastValue_.data();
 }
 
-void DegreeOfFreedom::incrementCurrentValue(const double &value)
+double *DegreeOfFreedomStore::getIntermediateValues()
 {
-    currentValue_ += value;
+    return intermediateValue_.data();
 }
 
-void DegreeOfFreedom::incrementCurrentFirstTimeDerivative(const double &value)
+double *DegreeOfFreedomStore::getInitialFirstTimeDerivatives()
 {
-    currentFirstTimeDerivative_ += value;
+    return initialFirstTimeDerivative_.data();
 }
 
-void DegreeOfFreedom::incrementCurrentSecondTimeDerivative(const double &value)
+double *DegreeOfFreedomStore::getCurrentFirstTimeDerivatives()
 {
-    currentSecondTimeDerivative_ += value;
+    return currentFirstTimeDerivative_.data();
 }
 
-void DegreeOfFreedom::setInitialFirstTimeDerivative(const double &value)
+double *DegreeOfFreedomStore::getPastFirstTimeDerivatives()
 {
-    initialFirstTimeDerivative_ = value;
+    return pastFirstTimeDerivative_.data();
 }
 
-void DegreeOfFreedom::setCurrentFirstTimeDerivative(const double &value)
+double *DegreeOfFreedomStore::getIntermediateFirstTimeDerivatives()
 {
-    currentFirstTimeDerivative_ = value;
+    return intermediateFirstTimeDerivative_.data();
 }
 
-void DegreeOfFreedom::setPastFirstTimeDerivative(const double &value)
+double *DegreeOfFreedomStore::getInitialSecondTimeDerivatives()
 {
-    pastFirstTimeDerivative_ = value;
+    return initialSecondTimeDerivative_.data();
 }
 
-void DegreeOfFreedom::setIntermediateFirstTimeDerivative(const double &value)
+double *DegreeOfFreedomStore::getCurrentSecondTimeDerivatives()
 {
-    intermediateFirstTimeDerivative_ = value;
+    return currentSecondTimeDerivative_.data();
 }
 
-void DegreeOfFreedom::setInitialSecondTimeDerivative(const double &value)
+double *DegreeOfFreedomStore::getPastSecondTimeDerivatives()
 {
-    initialSecondTimeDerivative_ = value;
+    return pastSecondTimeDerivative_.data();
 }
 
-void DegreeOfFreedom::setCurrentSecondTimeDerivative(const double &value)
+double *DegreeOfFreedomStore::getIntermediateSecondTimeDerivatives()
 {
-    currentSecondTimeDerivative_ = value;
+    return intermediateSecondTimeDerivative_.data();
 }
 
-void DegreeOfFreedom::setPastSecondTimeDerivative(const double &value)
+DegreeOfFreedom::DegreeOfFreedom(const DOFType &type, const double value)
+    : store_(new DegreeOfFreedomStore()),
+      slot_(0),
+      ownsStore_(true)
 {
-    pastSecondTimeDerivative_ = value;
+    store_->addSlot(type, value);
 }
 
-void DegreeOfFreedom::setIntermediateSecondTimeDerivative(const double &value)
-{
-    intermediateSecondTimeDerivative_ = value;
-}
+DegreeOfFreedom::DegreeOfFreedom(DegreeOfFreedomStore *store, const DOFType &type, const double value)
+    : store_(store),
+      slot_(store->addSlot(type, value)),
+      ownsStore_(false) {}
 
-void DegreeOfFreedom::setConstrained(const bool &isConstrained)
+DegreeOfFreedom::~DegreeOfFreedom()
 {
-    isConstrained_ = isConstrained;
+    if (ownsStore_)
+        delete store_;
 }
-
-bool DegreeOfFreedom::isConstrained()
-{
-    return isConstrained_;
-}
\ No newline at end of file
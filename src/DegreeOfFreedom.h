@@ -14,89 +14,159 @@ enum class DOFType
     LAGRANGE_MULTIPLIER
 };
 
+class DegreeOfFreedom;
+
+// Structure-of-arrays storage of the state of the degrees of freedom. Each DegreeOfFreedom is a handle to one slot.
+// After rebuild() the slots follow the order of the given handles, so with the dofs ordered by index, slot == index.
+class DegreeOfFreedomStore
+{
+public:
+    DegreeOfFreedomStore();
+
+    ~DegreeOfFreedomStore();
+
+    DegreeOfFreedomStore(const DegreeOfFreedomStore &store) = delete;
+
+    DegreeOfFreedomStore operator=(const DegreeOfFreedomStore &store) = delete;
+
+    int addSlot(const DOFType &type, const double &value);
+
+    // Moves the state of the given dofs (from whatever store holds them) to slots 0..n-1 of this store.
+    // Handles not in the list that still point to this store become invalid.
+    void rebuild(const std::vector<DegreeOfFreedom *> &dofs);
+
+    int getSize() const;
+
+    double getBytesPerDOF() const;
+
+    const DOFType *getTypes() const;
+
+    double *getInitialValues();
+
+    double *getCurrentValues();
+
+    double *getPastValues();
+
+    double *getIntermediateValues();
+
+    double *getInitialFirstTimeDerivatives();
+
+    double *getCurrentFirstTimeDerivatives();
+
+    double *getPastFirstTimeDerivatives();
+
+    double *getIntermediateFirstTimeDerivatives();
+
+    double *getInitialSecondTimeDerivatives();
+
+    double *getCurrentSecondTimeDerivatives();
+
+    double *getPastSecondTimeDerivatives();
+
+    double *getIntermediateSecondTimeDerivatives();
+
+private:
+    friend class DegreeOfFreedom;
+
+    std::vector<int> index_;
+    std::vector<DOFType> type_;
+    std::vector<double> initialValue_;
+    std::vector<double> currentValue_;
+    std::vector<double> pastValue_;
+    std::vector<double> intermediateValue_;
+    std::vector<double> initialFirstTimeDerivative_;
+    std::vector<double> currentFirstTimeDerivative_;
+    std::vector<double> pastFirstTimeDerivative_;
+    std::vector<double> intermediateFirstTimeDerivative_;
+    std::vector<double> initialSecondTimeDerivative_;
+    std::vector<double> currentSecondTimeDerivative_;
+    std::vector<double> pastSecondTimeDerivative_;
+    std::vector<double> intermediateSecondTimeDerivative_;
+    std::vector<char> isConstrained_;
+};
+
 class DegreeOfFreedom
 {
 public:
+    // Standalone dof: its state lives in a private one-slot store until it is moved to a shared store
     DegreeOfFreedom(const DOFType &type, const double value);
 
-    int getIndex() const;
+    DegreeOfFreedom(DegreeOfFreedomStore *store, const DOFType &type, const double value);
+
+    ~DegreeOfFreedom();
+
+    DegreeOfFreedom(const DegreeOfFreedom &dof) = delete;
 
-    DOFType getType() const;
+    DegreeOfFreedom operator=(const DegreeOfFreedom &dof) = delete;
 
-    double getInitialValue() const;
+    int getIndex() const { return store_->index_[slot_]; }
 
-    double getCurrentValue() const;
+    DOFType getType() const { return store_->type_[slot_]; }
 
-    double getPastValue() const;
+    double getInitialValue() const { return store_->initialValue_[slot_]; }
 
-    double getIntermediateValue() const;
+    double getCurrentValue() const { return store_->currentValue_[slot_]; }
 
-    double getInitialFirstTimeDerivative() const;
+    double getPastValue() const { return store_->pastValue_[slot_]; }
 
-    double getCurrentFirstTimeDerivative() const;
+    double getIntermediateValue() const { return store_->intermediateValue_[slot_]; }
 
-    double getPastFirstTimeDerivative() const;
+    double getInitialFirstTimeDerivative() const { return store_->initialFirstTimeDerivative_[slot_]; }
 
-    double getIntermediateFirstTimeDerivative() const;
+    double getCurrentFirstTimeDerivative() const { return store_->currentFirstTimeDerivative_[slot_]; }
 
-    double getInitialSecondTimeDerivative() const;
+    double getPastFirstTimeDerivative() const { return store_->pastFirstTimeDerivative_[slot_]; }
 
-    double getCurrentSecondTimeDerivative() const;
+    double getIntermediateFirstTimeDerivative() const { return store_->intermediateFirstTimeDerivative_[slot_]; }
 
-    double getPastSecondTimeDerivative() const;
+    double getInitialSecondTimeDerivative() const { return store_->initialSecondTimeDerivative_[slot_]; }
 
-    double getIntermediateSecondTimeDerivative() const;
+    double getCurrentSecondTimeDerivative() const { return store_->currentSecondTimeDerivative_[slot_]; }
 
-    void setIndex(const int &index);
+    double getPastSecondTimeDerivative() const { return store_->pastSecondTimeDerivative_[slot_]; }
 
-    void setInitialValue(const double &value);
+    double getIntermediateSecondTimeDerivative() const { return store_->intermediateSecondTimeDerivative_[slot_]; }
 
-    void setCurrentValue(const double &value);
+    void setIndex(const int &index) { store_->index_[slot_] = index; }
 
-    void setPastValue(const double &value);
+    void setInitialValue(const double &value) { store_->initialValue_[slot_] = value; }
 
-    void setIntermediateValue(const double &value);
+    void setCurrentValue(const double &value) { store_->currentValue_[slot_] = value; }
 
-    void incrementCurrentValue(const double &value);
+    void setPastValue(const double &value) { store_->pastValue_[slot_] = value; }
 
-    void incrementCurrentFirstTimeDerivative(const double &value);
+    void setIntermediateValue(const double &value) { store_->intermediateValue_[slot_] = value; }
 
-    void incrementCurrentSecondTimeDerivative(const double &value);
+    void incrementCurrentValue(const double &value) { store_->currentValue_[slot_] += value; }
 
-    void setInitialFirstTimeDerivative(const double &value);
+    void incrementCurrentFirstTimeDerivative(const double &value) { store_->currentFirstTimeDerivative_[slot_] += value; }
 
-    void setCurrentFirstTimeDerivative(const double &value);
+    void incrementCurrentSecondTimeDerivative(const double &value) { store_->currentSecondTimeDerivative_[slot_] += value; }
 
-    void setPastFirstTimeDerivative(const double &value);
+    void setInitialFirstTimeDerivative(const double &value) { store_->initialFirstTimeDerivative_[slot_] = value; }
 
-    void setIntermediateFirstTimeDerivative(const double &value);
+    void setCurrentFirstTimeDerivative(const double &value) { store_->currentFirstTimeDerivative_[slot_] = value; }
 
-    void setInitialSecondTimeDerivative(const double &value);
+    void setPastFirstTimeDerivative(const double &value) { store_->pastFirstTimeDerivative_[slot_] = value; }
 
-    void setCurrentSecondTimeDerivative(const double &value);
+    void setIntermediateFirstTimeDerivative(const double &value) { store_->intermediateFirstTimeDerivative_[slot_] = value; }
 
-    void setPastSecondTimeDerivative(const double &value);
+    void setInitialSecondTimeDerivative(const double &value) { store_->initialSecondTimeDerivative_[slot_] = value; }
 
-    void setIntermediateSecondTimeDerivative(const double &value);
+    void setCurrentSecondTimeDerivative(const double &value) { store_->currentSecondTimeDerivative_[slot_] = value; }
 
-    void setConstrained(const bool &isConstrained);
+    void setPastSecondTimeDerivative(const double &value) { store_->pastSecondTimeDerivative_[slot_] = value; }
 
-    bool isConstrained();
+    void setIntermediateSecondTimeDerivative(const double &value) { store_->intermediateSecondTimeDerivative_[slot_] = value; }
+
+    void setConstrained(const bool &isConstrained) { store_->isConstrained_[slot_] = isConstrained; }
+
+    bool isConstrained() { return store_->isConstrained_[slot_]; }
 
 private:
-    int index_;
-    DOFType type_;
-    double initialValue_;
-    double currentValue_;
-    double pastValue_;
-    double intermediateValue_;
-    double initialFirstTimeDerivative_;
-    double currentFirstTimeDerivative_;
-    double pastFirstTimeDerivative_;
-    double intermediateFirstTimeDerivative_;
-    double initialSecondTimeDerivative_;
-    double currentSecondTimeDerivative_;
-    double pastSecondTimeDerivative_;
-    double intermediateSecondTimeDerivative_;
-    bool isConstrained_;
-};
\ No newline at end of file
+    friend class DegreeOfFreedomStore;
+
+    DegreeOfFreedomStore *store_;
+    int slot_;
+    bool ownsStore_;
+};
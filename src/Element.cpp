@@ -8,7 +8,8 @@ Element::Element(const int index,
           isActive_(true),
           referenceConfiguration_(ReferenceConfiguration::PAST),
           material_(nullptr),
-          degreesOfFreedom_(degreesOfFreedom) {}
+          degreesOfFreedom_(degreesOfFreedom),
+          referenceGeometry_(nullptr) {}
 
 void Element::setIndex(const int& index)
 {
@@ -40,6 +41,26 @@ void Element::setDegreesOfFreedom(const std::vector<DegreeOfFreedom*>& degreesOf
     degreesOfFreedom_ = degreesOfFreedom;
 }
 
+void Element::setReferenceGeometry(const double* referenceGeometry)
+{
+    referenceGeometry_ = referenceGeometry;
+}
+
+int Element::getReferenceGeometrySize() const
+{
+    return 0;
+}
+
+void Element::computeReferenceGeometry(double* referenceGeometry) const
+{
+}
+
+void Element::getLumpedMass(double* mass) const
+{
+    for (unsigned int i = 0; i < degreesOfFreedom_.size(); i++)
+        mass[i] = 0.0;
+}
+
 void Element::setMaterial(Material *material)
 {
     material_ = material;
@@ -22,6 +22,9 @@ class Element
     void setReferenceConfiguration(const ReferenceConfiguration reference);
 
     void setDegreesOfFreedom(const std::vector<DegreeOfFreedom*>& degreesOfFreedom);
+
+    // Cached reference geometry (weight * j0 followed by dphi_dx at every quadrature point), owned by the domain
+    void setReferenceGeometry(const double* referenceGeometry);
     
     void setMaterial(Material *material);
 
@@ -52,11 +55,21 @@ class Element
 
     virtual void getCauchyStress(double**& nodalCauchyStress) const = 0;
 
+    // indexes, rhsValues and hessianValues are caller-owned buffers with room for at least
+    // getNumberOfDOFs() entries (getNumberOfDOFs()^2 for the hessian, stored row-major).
+    // A null hessianValues asks for the right hand side alone.
     virtual void elementContributions(int& ndofs1,
                                         int& ndofs2,
-                                        int*& indexes,
-                                        double*& rhsValues,
-                                        double*& hessianValues) const = 0;
+                                        int* indexes,
+                                        double* rhsValues,
+                                        double* hessianValues) const = 0;
+
+    virtual int getReferenceGeometrySize() const;
+
+    virtual void computeReferenceGeometry(double* referenceGeometry) const;
+
+    // Diagonal mass of every position dof (getNumberOfDOFs() entries, zero for the other dofs)
+    virtual void getLumpedMass(double* mass) const;
 
     virtual void clearNeighborElements() = 0;
 
@@ -77,4 +90,5 @@ class Element
     ReferenceConfiguration referenceConfiguration_;
     std::vector<DegreeOfFreedom*> degreesOfFreedom_;
     std::vector<Element*> neighborElements_;
+    const double* referenceGeometry_;
 };
\ No newline at end of file
@@ -64,9 +64,13 @@ void LineElement::getDOFIndexes(unsigned int& ndof,
 
 void LineElement::elementContributions(int& ndofs1,
                                         int& ndofs2,
-                                        int*& indexes,
-                                        double*& rhsValues,
-                                        double*& hessianValues) const {}
+                                        int* indexes,
+                                        double* rhsValues,
+                                        double* hessianValues) const
+{
+    ndofs1 = 0;
+    ndofs2 = 0;
+}
 
 void LineElement::getEnergy(double &deformationEnergy,
                              double &kinectEnergy,
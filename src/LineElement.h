@@ -36,9 +36,9 @@ class LineElement : public Element
 
     void elementContributions(int& ndofs1,
                                         int& ndofs2,
-                                        int*& indexes,
-                                        double*& rhsValues,
-                                        double*& hessianValues) const override;
+                                        int* indexes,
+                                        double* rhsValues,
+                                        double* hessianValues) const override;
     void getEnergy(double &deformationEnergy,
                    double &kinectEnergy,
                    double &domainForcePotentialEnergy) const override;
@@ -68,6 +68,11 @@ double ElasticSolid::getPoisson() const
     return poisson_;
 }
 
+ConstitutiveModel ElasticSolid::getConstitutiveModel() const
+{
+    return model_;
+}
+
 void ElasticSolid::getPlaneStressTensor(const double E[3],
                                         const double CI[2][2],
                                         double S[3]) const
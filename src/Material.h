@@ -112,6 +112,8 @@ public:
 
 	double getPoisson() const;
 
+	ConstitutiveModel getConstitutiveModel() const;
+
 	double getFrictionCoefficient() const;
 
 	void getPlaneStressTensor(const double E[3],
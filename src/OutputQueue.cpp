@@ -0,0 +1,79 @@
+#include "OutputQueue.h"
+#include <algorithm>
+#include <chrono>
+
+OutputQueue::OutputQueue(const int &maxSnapshots)
+    : maxSnapshots_(std::max(1, maxSnapshots)),
+      finished_(false),
+      writing_(false),
+      numberOfTasks_(0),
+      waitingTime_(0.0)
+{
+    thread_ = std::thread(&OutputQueue::run, this);
+}
+
+OutputQueue::~OutputQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_ = true;
+    }
+    taskAvailable_.notify_one();
+    thread_.join();
+}
+
+void OutputQueue::push(std::function<void()> task)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if ((int)tasks_.size() + (writing_ ? 1 : 0) >= maxSnapshots_)
+    {
+        auto start_timer = std::chrono::high_resolution_clock::now();
+        taskWritten_.wait(lock, [this]
+                          { return (int)tasks_.size() + (writing_ ? 1 : 0) < maxSnapshots_; });
+        auto end_timer = std::chrono::high_resolution_clock::now();
+        waitingTime_ += std::chrono::duration_cast<std::chrono::duration<double>>(end_timer - start_timer).count();
+    }
+    tasks_.push_back(std::move(task));
+    numberOfTasks_++;
+    lock.unlock();
+    taskAvailable_.notify_one();
+}
+
+void OutputQueue::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    taskWritten_.wait(lock, [this]
+                      { return tasks_.empty() && !writing_; });
+}
+
+int OutputQueue::getNumberOfTasks() const
+{
+    return numberOfTasks_;
+}
+
+double OutputQueue::getWaitingTime() const
+{
+    return waitingTime_;
+}
+
+void OutputQueue::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        taskAvailable_.wait(lock, [this]
+                            { return finished_ || !tasks_.empty(); });
+        if (tasks_.empty())
+            return;
+
+        std::function<void()> task = std::move(tasks_.front());
+        tasks_.pop_front();
+        writing_ = true;
+        lock.unlock();
+        task();
+        task = nullptr; // the snapshot is released before the slot is
+        lock.lock();
+        writing_ = false;
+        taskWritten_.notify_all();
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Background thread that runs the output tasks (formatting and writing of files) in the order they are pushed.
+// Each task owns the snapshot of the results it writes. At most maxSnapshots of them are alive at a time, the one
+// being written included, so the memory stays bounded and push only blocks when the writer falls that far behind.
+class OutputQueue
+{
+public:
+    OutputQueue(const int &maxSnapshots);
+
+    // Writes the pending tasks before joining the thread
+    ~OutputQueue();
+
+    void push(std::function<void()> task);
+
+    // Waits until every pushed task is written
+    void flush();
+
+    int getNumberOfTasks() const;
+
+    // Seconds the callers of push spent blocked on a full queue
+    double getWaitingTime() const;
+
+private:
+    void run();
+
+    int maxSnapshots_;
+    bool finished_;
+    bool writing_;
+    int numberOfTasks_;
+    double waitingTime_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable taskAvailable_;
+    std::condition_variable taskWritten_;
+    std::thread thread_;
+};
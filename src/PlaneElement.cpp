@@ -74,126 +74,356 @@ void PlaneElement::getDOFIndexes(unsigned int &ndof,
     }
 }
 
+namespace
+{
+    // Constitutive kernels used by the specialized element contributions. Each one gives the second Piola-Kirchhoff
+    // stress and its derivative with respect to the position dofs at a quadrature point.
+
+    // Saint Venant-Kirchhoff solid: S = C : E with the plane stress/strain coefficients evaluated once per element
+    struct SaintVenantKirchhoffKernel
+    {
+        double c11, c12, c33;
+
+        explicit SaintVenantKirchhoffKernel(const ElasticSolid *material)
+        {
+            const double young = material->getYoung();
+            const double poisson = material->getPoisson();
+            if (material->getPlaneAnalysis() == PLANE_STRAIN)
+            {
+                const double prop1 = young / ((1.0 + poisson) * (1.0 - 2.0 * poisson));
+                c11 = prop1 * (1.0 - poisson);
+                c12 = prop1 * poisson;
+            }
+            else
+            {
+                const double prop1 = young / (1.0 - (poisson * poisson));
+                c11 = prop1;
+                c12 = prop1 * poisson;
+            }
+            c33 = young / (1.0 + poisson);
+        }
+
+        template <int NumberOfNodes>
+        void stressAndDerivative(const PlaneElement &element, double dphi_dx[][2], const double dy_dx[2][2], const double dx_dy[2][2],
+                                 const double dE_dy[][3], double S[3], double dS_dy[][3]) const
+        {
+            double E[3];
+            element.getStrainTensor(dy_dx, E);
+            S[0] = c11 * E[0] + c12 * E[1]; // S[0][0]
+            S[1] = c11 * E[1] + c12 * E[0]; // S[1][1]
+            S[2] = c33 * E[2];              // S[0][1]
+            for (int i = 0; i < 2 * NumberOfNodes; i++)
+            {
+                dS_dy[i][0] = c11 * dE_dy[i][0] + c12 * dE_dy[i][1]; // dS_dy[0][0]
+                dS_dy[i][1] = c11 * dE_dy[i][1] + c12 * dE_dy[i][0]; // dS_dy[1][1]
+                dS_dy[i][2] = c33 * dE_dy[i][2];                     // dS_dy[0][1]
+            }
+        }
+    };
+
+    // Any other solid law, evaluated by the material from the Green-Lagrange strain
+    struct HyperelasticKernel
+    {
+        const Material *material;
+
+        template <int NumberOfNodes>
+        void stressAndDerivative(const PlaneElement &element, double dphi_dx[][2], const double dy_dx[2][2], const double dx_dy[2][2],
+                                 const double dE_dy[][3], double S[3], double dS_dy[][3]) const
+        {
+            double E[3];
+            element.getStrainTensor(dy_dx, E);
+            material->getPlaneStressTensorAndDerivative(2 * NumberOfNodes, E, dE_dy, nullptr, S, dS_dy);
+        }
+    };
+
+    // Newtonian fluid, evaluated by the material from the strain rate
+    struct ViscousFluidKernel
+    {
+        const Material *material;
+
+        template <int NumberOfNodes>
+        void stressAndDerivative(const PlaneElement &element, double dphi_dx[][2], const double dy_dx[2][2], const double dx_dy[2][2],
+                                 const double dE_dy[][3], double S[3], double dS_dy[][3]) const
+        {
+            double dv_dx[2][2];
+            double dE_dt[3];
+            double dE_dtdy[2 * NumberOfNodes][3];
+            element.getDeformationGradientTimeDerivative(dphi_dx, dv_dx);
+            element.getStrainTensorTimeDerivative(dy_dx, dv_dx, dE_dt);
+            element.getStrainTensorTimeDerivativeFirstDerivative(dy_dx, dv_dx, dphi_dx, dE_dtdy);
+            material->getPlaneStressTensorAndDerivative(2 * NumberOfNodes, dE_dt, dE_dtdy, dx_dy, S, dS_dy);
+        }
+    };
+}
+
 void PlaneElement::elementContributions(int &ndofs1,
                                         int &ndofs2,
-                                        int *&indexes,
-                                        double *&rhsValues,
-                                        double *&hessianValues) const
+                                        int *indexes,
+                                        double *rhsValues,
+                                        double *hessianValues) const
 {
-    unsigned int ndofs;
-    getDOFIndexes(ndofs, indexes);
-    unsigned int nterms = ndofs * ndofs;
+    const unsigned int ndofs = degreesOfFreedom_.size();
+    for (unsigned int i = 0; i < ndofs; i++)
+        indexes[i] = degreesOfFreedom_[i]->getIndex();
 
-    const std::vector<Node *> &nodes = base_->getNodes();
-    const unsigned int numberOfNodes = nodes.size();
-    ndofs1 = 2 * nodes.size(); // number of position degrees of freedom
-    ndofs2 = ndofs - ndofs1;   // number of pressure degrees of freedom
-    bool mixedFormulation = ndofs2;
+    ndofs1 = 2 * base_->getNodes().size(); // number of position degrees of freedom
+    ndofs2 = ndofs - ndofs1;              // number of pressure degrees of freedom
+
+    // The kernel is chosen once per element, so that node counts and loop bounds are known at compile time
+    switch (base_->getParametricElement()->getElementType())
+    {
+    case T3:
+        dispatchConstitutiveModel<3>(rhsValues, hessianValues);
+        break;
+    case T6:
+        dispatchConstitutiveModel<6>(rhsValues, hessianValues);
+        break;
+    case T10:
+        dispatchConstitutiveModel<10>(rhsValues, hessianValues);
+        break;
+    case Q4:
+        dispatchConstitutiveModel<4>(rhsValues, hessianValues);
+        break;
+    case Q9:
+        dispatchConstitutiveModel<9>(rhsValues, hessianValues);
+        break;
+    case Q16:
+        dispatchConstitutiveModel<16>(rhsValues, hessianValues);
+        break;
+    default:
+        std::cout << "Element type not supported by PlaneElement.\n";
+        exit(EXIT_FAILURE);
+    }
+}
+
+template <int NumberOfNodes>
+void PlaneElement::dispatchConstitutiveModel(double *rhsValues,
+                                             double *hessianValues) const
+{
+    switch (material_->getType())
+    {
+    case MaterialType::ELASTIC_SOLID:
+    case MaterialType::ELASTIC_INCOMPRESSIBLE_SOLID:
+    {
+        const ElasticSolid *solid = dynamic_cast<const ElasticSolid *>(material_);
+        if (solid && solid->getConstitutiveModel() == SAINT_VENANT_KIRCHHOFF)
+            dispatchFormulation<NumberOfNodes>(SaintVenantKirchhoffKernel(solid), rhsValues, hessianValues);
+        else
+            dispatchFormulation<NumberOfNodes>(HyperelasticKernel{material_}, rhsValues, hessianValues);
+        break;
+    }
+    case MaterialType::NEWTONIAN_INCOMPRESSIBLE_FLUID:
+        dispatchFormulation<NumberOfNodes>(ViscousFluidKernel{material_}, rhsValues, hessianValues);
+        break;
+    default:
+        dispatchFormulation<NumberOfNodes>(HyperelasticKernel{material_}, rhsValues, hessianValues);
+        break;
+    }
+}
+
+template <int NumberOfNodes, class ConstitutiveKernel>
+void PlaneElement::dispatchFormulation(const ConstitutiveKernel &constitutive,
+                                       double *rhsValues,
+                                       double *hessianValues) const
+{
+    const bool mixedFormulation = degreesOfFreedom_.size() > 2 * NumberOfNodes;
+    const bool lumpedMass = parameters_->useLumpedMass();
 
-    rhsValues = new double[ndofs];
-    hessianValues = new double[nterms];
+    // Without a hessian buffer only the right hand side is evaluated
+    if (!hessianValues)
+    {
+        if (mixedFormulation)
+        {
+            if (lumpedMass)
+                computeContributions<NumberOfNodes, true, true, false>(constitutive, rhsValues, hessianValues);
+            else
+                computeContributions<NumberOfNodes, true, false, false>(constitutive, rhsValues, hessianValues);
+        }
+        else
+        {
+            if (lumpedMass)
+                computeContributions<NumberOfNodes, false, true, false>(constitutive, rhsValues, hessianValues);
+            else
+                computeContributions<NumberOfNodes, false, false, false>(constitutive, rhsValues, hessianValues);
+        }
+        return;
+    }
 
-    for (int i = 0; i < nterms; i++)
+    if (mixedFormulation)
+    {
+        if (lumpedMass)
+            computeContributions<NumberOfNodes, true, true, true>(constitutive, rhsValues, hessianValues);
+        else
+            computeContributions<NumberOfNodes, true, false, true>(constitutive, rhsValues, hessianValues);
+    }
+    else
     {
-        hessianValues[i] = 0.0;
+        if (lumpedMass)
+            computeContributions<NumberOfNodes, false, true, true>(constitutive, rhsValues, hessianValues);
+        else
+            computeContributions<NumberOfNodes, false, false, true>(constitutive, rhsValues, hessianValues);
     }
+}
+
+template <int NumberOfNodes, bool Mixed, bool LumpedMass, bool Hessian, class ConstitutiveKernel>
+void PlaneElement::computeContributions(const ConstitutiveKernel &constitutive,
+                                        double *rhsValues,
+                                        double *hessianValues) const
+{
+    constexpr int ndofs1 = 2 * NumberOfNodes;       // number of position degrees of freedom
+    constexpr int ndofs2 = Mixed ? NumberOfNodes : 0; // number of pressure degrees of freedom
+    constexpr int ndofs = ndofs1 + ndofs2;
+
+    if (Hessian)
+        for (int i = 0; i < ndofs * ndofs; i++)
+            hessianValues[i] = 0.0;
 
     for (int i = 0; i < ndofs; i++)
         rhsValues[i] = 0.0;
 
+    // Nodal values are gathered once per element
+    const std::vector<Node *> &nodes = base_->getNodes();
+    double x[NumberOfNodes][2];      // reference position
+    double y[NumberOfNodes][2];      // intermediate position
+    double accelN[NumberOfNodes][2]; // intermediate acceleration
+    double pN[NumberOfNodes];        // current pressure
+    for (int a = 0; a < NumberOfNodes; a++)
+    {
+        const DegreeOfFreedom *dof0 = nodes[a]->getDegreeOfFreedom(0);
+        const DegreeOfFreedom *dof1 = nodes[a]->getDegreeOfFreedom(1);
+        if (!referenceGeometry_)
+            switch (referenceConfiguration_)
+            {
+            case ReferenceConfiguration::INITIAL:
+                x[a][0] = dof0->getInitialValue();
+                x[a][1] = dof1->getInitialValue();
+                break;
+            case ReferenceConfiguration::PAST:
+                x[a][0] = dof0->getPastValue();
+                x[a][1] = dof1->getPastValue();
+                break;
+            case ReferenceConfiguration::CURRENT:
+                std::cout << "Updated Lagrangian Formulation is not implemented on this version of the code.\n";
+                exit(EXIT_FAILURE);
+            }
+        y[a][0] = dof0->getIntermediateValue();
+        y[a][1] = dof1->getIntermediateValue();
+        accelN[a][0] = dof0->getIntermediateSecondTimeDerivative();
+        accelN[a][1] = dof1->getIntermediateSecondTimeDerivative();
+        if (Mixed)
+            pN[a] = nodes[a]->getDegreeOfFreedom(2)->getCurrentValue();
+    }
+
     const std::vector<QuadraturePoint *> &quadraturePoints = base_->getParametricElement()->getQuadraturePoints();
-    const unsigned int numberOfQuadraturePoints = quadraturePoints.size();
 
     double density = material_->getDensity();
     double *gravity = parameters_->getGravity();
     double deltat = parameters_->getDeltat();
     double alphaF = parameters_->getAlphaF();
     double alphaM = parameters_->getAlphaM();
-    double gamma = parameters_->getGamma();
     double beta = parameters_->getBeta();
 
     double tpspg = (0.5 * deltat * deltat) / density; // tpspg = 0.0;
     // double tpspg = computeStabilizationParameter();
 
-    for (auto &qp : quadraturePoints)
+    double lumpedFractions[NumberOfNodes];
+    if (LumpedMass)
+        getLumpedMassFractions(lumpedFractions);
+
+    const double *cachedGeometry = referenceGeometry_;
+    for (QuadraturePoint *const &qp : quadraturePoints)
     {
         double *phi = qp->getShapeFunctionsValues();
-        double **dphi_dxsi = qp->getShapeFunctionsDerivativesValues();
-        double weight = qp->getWeight();
 
-        double dx_dxsi[2][2];
-        getReferenceJacobianMatrix(dphi_dxsi, dx_dxsi);
-        double j0 = getMatrixDeterminant(dx_dxsi);
+        double factor1; // weight * j0
+        double dphi_dx[NumberOfNodes][2];
+        if (cachedGeometry)
+        {
+            factor1 = cachedGeometry[0];
+            for (int a = 0; a < NumberOfNodes; a++)
+            {
+                dphi_dx[a][0] = cachedGeometry[1 + 2 * a];
+                dphi_dx[a][1] = cachedGeometry[2 + 2 * a];
+            }
+            cachedGeometry += 1 + 2 * NumberOfNodes;
+        }
+        else
+        {
+            double **dphi_dxsi = qp->getShapeFunctionsDerivativesValues();
 
-        double dxsi_dx[2][2];
-        getInverseMatrix(dx_dxsi, j0, dxsi_dx);
+            double dx_dxsi[2][2] = {};
+            for (int a = 0; a < NumberOfNodes; a++)
+            {
+                dx_dxsi[0][0] += dphi_dxsi[0][a] * x[a][0];
+                dx_dxsi[0][1] += dphi_dxsi[1][a] * x[a][0];
+                dx_dxsi[1][0] += dphi_dxsi[0][a] * x[a][1];
+                dx_dxsi[1][1] += dphi_dxsi[1][a] * x[a][1];
+            }
+            double j0 = getMatrixDeterminant(dx_dxsi);
+            factor1 = qp->getWeight() * j0;
 
-        double dphi_dx[numberOfNodes][2];
-        getReferenceShapeFunctionsGradient(dphi_dxsi, dxsi_dx, dphi_dx);
+            double dxsi_dx[2][2];
+            getInverseMatrix(dx_dxsi, j0, dxsi_dx);
 
-        double dy_dx[2][2];
-        getDeformationGradient(dphi_dx, dy_dx);
+            for (int a = 0; a < NumberOfNodes; a++)
+            {
+                dphi_dx[a][0] = dphi_dxsi[0][a] * dxsi_dx[0][0] + dphi_dxsi[1][a] * dxsi_dx[1][0];
+                dphi_dx[a][1] = dphi_dxsi[0][a] * dxsi_dx[0][1] + dphi_dxsi[1][a] * dxsi_dx[1][1];
+            }
+        }
+
+        double dy_dx[2][2] = {};
+        for (int a = 0; a < NumberOfNodes; a++)
+        {
+            dy_dx[0][0] += dphi_dx[a][0] * y[a][0];
+            dy_dx[0][1] += dphi_dx[a][1] * y[a][0];
+            dy_dx[1][0] += dphi_dx[a][0] * y[a][1];
+            dy_dx[1][1] += dphi_dx[a][1] * y[a][1];
+        }
 
         double jacobian = getMatrixDeterminant(dy_dx);
 
         double dx_dy[2][2];
         getInverseMatrix(dy_dx, jacobian, dx_dy);
 
-        double dphi_dy[numberOfNodes][2];
-        for (int i = 0; i < numberOfNodes; i++)
-        {
-            dphi_dy[i][0] = dphi_dx[i][0] * dx_dy[0][0] + dphi_dx[i][1] * dx_dy[1][0];
-            dphi_dy[i][1] = dphi_dx[i][0] * dx_dy[0][1] + dphi_dx[i][1] * dx_dy[1][1];
-        }
-
         double CI[3];
         getInverseRightCauchyTensor(dx_dy, CI);
 
         double dE_dy[ndofs1][3];
-        getStrainTensorFirstDerivative(dy_dx, dphi_dx, dE_dy);
+        for (int i = 0; i < ndofs1; i++)
+        {
+            const int a = i / 2; // node a
+            const int j = i % 2; // dof j
+            dE_dy[i][0] = dphi_dx[a][0] * dy_dx[j][0];                                       // dE_dy[0][0]
+            dE_dy[i][1] = dphi_dx[a][1] * dy_dx[j][1];                                       // dE_dy[1][1]
+            dE_dy[i][2] = 0.5 * (dphi_dx[a][0] * dy_dx[j][1] + dy_dx[j][0] * dphi_dx[a][1]); // dE_dy[0][1]
+        }
 
-        double E[3];
-        double dv_dx[2][2];
-        double dE_dt[3];
         double S[3];
-        double dE_dtdy[ndofs1][3];
         double dS_dy[ndofs1][3];
-
-        switch (material_->getType())
-        {
-        case MaterialType::ELASTIC_SOLID:
-            getStrainTensor(dy_dx, E);
-            material_->getPlaneStressTensorAndDerivative(ndofs1, E, dE_dy, nullptr, S, dS_dy);
-            break;
-        case MaterialType::ELASTIC_INCOMPRESSIBLE_SOLID:
-            getStrainTensor(dy_dx, E);
-            material_->getPlaneStressTensorAndDerivative(ndofs1, E, dE_dy, nullptr, S, dS_dy);
-            break;
-        case MaterialType::NEWTONIAN_INCOMPRESSIBLE_FLUID:
-            getDeformationGradientTimeDerivative(dphi_dx, dv_dx);
-            getStrainTensorTimeDerivative(dy_dx, dv_dx, dE_dt);
-            getStrainTensorTimeDerivativeFirstDerivative(dy_dx, dv_dx, dphi_dx, dE_dtdy);
-            material_->getPlaneStressTensorAndDerivative(ndofs1, dE_dt, dE_dtdy, dx_dy, S, dS_dy);
-            break;
-        }
+        constitutive.template stressAndDerivative<NumberOfNodes>(*this, dphi_dx, dy_dx, dx_dy, dE_dy, S, dS_dy);
 
         double accel[2] = {0.0, 0.0}; // acceleration at integration point
-        for (unsigned int i = 0; i < numberOfNodes; i++)
-        {
-            accel[0] += phi[i] * nodes[i]->getDegreeOfFreedom(0)->getIntermediateSecondTimeDerivative();
-            accel[1] += phi[i] * nodes[i]->getDegreeOfFreedom(1)->getIntermediateSecondTimeDerivative();
-        }
+        if (!LumpedMass)
+            for (int a = 0; a < NumberOfNodes; a++)
+            {
+                accel[0] += phi[a] * accelN[a][0];
+                accel[1] += phi[a] * accelN[a][1];
+            }
 
         double pressure = 0.0;        // pressure at integration point
         double dp_dx[2] = {0.0, 0.0}; // pressure gradient at integration point
-        for (unsigned int i = 0; i < ndofs2; i++)
-        {
-            pressure += phi[i] * nodes[i]->getDegreeOfFreedom(2)->getCurrentValue();
-            dp_dx[0] += dphi_dy[i][0] * nodes[i]->getDegreeOfFreedom(2)->getCurrentValue();
-            dp_dx[1] += dphi_dy[i][1] * nodes[i]->getDegreeOfFreedom(2)->getCurrentValue();
-        }
+        double dphi_dy[NumberOfNodes][2];
+        if (Mixed)
+            for (int a = 0; a < NumberOfNodes; a++)
+            {
+                dphi_dy[a][0] = dphi_dx[a][0] * dx_dy[0][0] + dphi_dx[a][1] * dx_dy[1][0];
+                dphi_dy[a][1] = dphi_dx[a][0] * dx_dy[0][1] + dphi_dx[a][1] * dx_dy[1][1];
+                pressure += phi[a] * pN[a];
+                dp_dx[0] += dphi_dy[a][0] * pN[a];
+                dp_dx[1] += dphi_dy[a][1] * pN[a];
+            }
 
-        const double factor1 = weight * j0;
         const double factor2 = alphaF * factor1;
         const double factor3 = pressure * jacobian;
         const double factor4 = alphaM * density * factor1 / (beta * deltat * deltat);
@@ -208,19 +438,19 @@ void PlaneElement::elementContributions(int &ndofs1,
             for (int i = 0; i < ndofs1; i++)
             {
                 // node a
-                int a = i / 2;
+                const int a = i / 2;
                 // dof k
-                int k = i % 2;
+                const int k = i % 2;
 
                 // internal force
                 double v = doubleContraction(S, dE_dy[i]);
 
                 // inertial and domain force
                 double m, bf;
-                if (parameters_->useLumpedMass())
+                if (LumpedMass)
                 {
-                    m = density * nodes[a]->getDegreeOfFreedom(k)->getIntermediateSecondTimeDerivative() / 3.0;
-                    bf = density * gravity[k] / 3.0;
+                    m = density * accelN[a][k] * lumpedFractions[a];
+                    bf = density * gravity[k] * lumpedFractions[a];
                 }
                 else
                 {
@@ -229,39 +459,46 @@ void PlaneElement::elementContributions(int &ndofs1,
                 }
 
                 // pressure force
-                double p = factor3 * doubleContraction(CI, dE_dy[i]);
+                const double CI_dE = doubleContraction(CI, dE_dy[i]);
+                double p = factor3 * CI_dE;
 
                 rhsValues[i] -= (v + m + p - bf) * factor1;
 
+                if (!Hessian)
+                    continue;
+
+                double *hessianRow = hessianValues + i * ndofs;
+
                 // Position degrees of freedom
                 for (int j = 0; j < ndofs1; j++)
                 {
                     // node b
-                    int b = j / 2;
+                    const int b = j / 2;
                     // dof l
-                    int l = j % 2;
+                    const int l = j % 2;
 
-                    hessianValues[i * ndofs + j] += (doubleContraction(dE_dy[j], dS_dy[i]))*factor2;
+                    double value = doubleContraction(dE_dy[j], dS_dy[i]) * factor2;
 
-                    if (parameters_->useLumpedMass() && i == j)
-                        hessianValues[i * ndofs + j] += factor4 / 3.0;
+                    if (LumpedMass && i == j)
+                        value += factor4 * lumpedFractions[a];
 
                     if (k == l)
                     {
                         double d2E_dydy[3];
                         getStrainTensorSecondDerivative(a, b, dphi_dx, d2E_dydy);
-                        hessianValues[i * ndofs + j] += doubleContraction(S, d2E_dydy) * factor2;
-                        if (!parameters_->useLumpedMass())
-                            hessianValues[i * ndofs + j] += factor4 * phi[a] * phi[b];
+                        value += doubleContraction(S, d2E_dydy) * factor2;
+                        if (!LumpedMass)
+                            value += factor4 * phi[a] * phi[b];
                     }
+                    hessianRow[j] += value;
                 }
                 // Pressure degrees of freedom
                 for (int j = 0; j < ndofs2; j++)
                 {
                     // node b
-                    int b = j;
+                    const int b = j;
 
-                    hessianValues[ndofs1 + i * ndofs + j] += phi[b] * doubleContraction(CI, dE_dy[i]) * factor5;
+                    hessianRow[ndofs1 + j] += phi[b] * CI_dE * factor5;
                 }
             }
         }
@@ -269,7 +506,7 @@ void PlaneElement::elementContributions(int &ndofs1,
             for (int i = 0; i < ndofs2; i++)
             {
                 // node a
-                int a = i;
+                const int a = i;
 
                 // incompressibility constrain
                 double c = phi[a] * factor6;
@@ -278,38 +515,587 @@ void PlaneElement::elementContributions(int &ndofs1,
                 double bf_pspg = factor7 * (dphi_dy[a][0] * gravity[0] + dphi_dy[a][1] * gravity[1]); // bf_pspg = 0.0;
 
                 // pspg mass part
-                double m_pspg = factor7 * (dphi_dy[a][0] * accel[0] + dphi_dy[a][1] * accel[1]);
-                m_pspg = 0.0;
+                double m_pspg = 0.0; // factor7 * (dphi_dy[a][0] * accel[0] + dphi_dy[a][1] * accel[1]);
 
                 // pspg pressure part
                 double p_pspg = factor8 * (dphi_dy[a][0] * dp_dx[0] + dphi_dy[a][1] * dp_dx[1]);
 
                 rhsValues[ndofs1 + i] -= (c + m_pspg - p_pspg - bf_pspg) * factor1;
 
+                if (!Hessian)
+                    continue;
+
+                double *hessianRow = hessianValues + ndofs * (ndofs1 + i);
+
                 // Position degrees of freedom
                 for (int j = 0; j < ndofs1; j++)
                 {
-                    // node b
-                    int b = j / 2;
-                    // dof l
-                    int l = j % 2;
-
-                    hessianValues[ndofs * (ndofs1 + i) + j] += phi[a] * doubleContraction(CI, dE_dy[j]) * factor9;
-                    // hessianValues[ndofs*(ndofs1+i) + j] += tpspg * factor4 * dphi_dy[a][l] * phi[b];
+                    hessianRow[j] += phi[a] * doubleContraction(CI, dE_dy[j]) * factor9;
+                    // hessianRow[j] += tpspg * factor4 * dphi_dy[a][l] * phi[b];
                 }
                 // Pressure degrees of freedom
                 for (int j = 0; j < ndofs2; j++)
                 {
                     // node b
-                    int b = j;
+                    const int b = j;
+
+                    hessianRow[ndofs1 + j] += -(dphi_dy[a][0] * dphi_dy[b][0] +
+                                                dphi_dy[a][1] * dphi_dy[b][1]) *
+                                              factor10;
+                }
+            }
+        }
+    }
+}
+
+int PlaneElement::getReferenceGeometrySize() const
+{
+    const int numberOfNodes = base_->getNodes().size();
+    return base_->getParametricElement()->getQuadraturePoints().size() * (1 + 2 * numberOfNodes);
+}
+
+void PlaneElement::computeReferenceGeometry(double *referenceGeometry) const
+{
+    const unsigned int numberOfNodes = base_->getNodes().size();
+    for (QuadraturePoint *const &qp : base_->getParametricElement()->getQuadraturePoints())
+    {
+        double **dphi_dxsi = qp->getShapeFunctionsDerivativesValues();
+
+        double dx_dxsi[2][2];
+        getReferenceJacobianMatrix(dphi_dxsi, dx_dxsi);
+        double j0 = getMatrixDeterminant(dx_dxsi);
+
+        double dxsi_dx[2][2];
+        getInverseMatrix(dx_dxsi, j0, dxsi_dx);
+
+        double dphi_dx[numberOfNodes][2];
+        getReferenceShapeFunctionsGradient(dphi_dxsi, dxsi_dx, dphi_dx);
+
+        referenceGeometry[0] = qp->getWeight() * j0;
+        for (unsigned int a = 0; a < numberOfNodes; a++)
+        {
+            referenceGeometry[1 + 2 * a] = dphi_dx[a][0];
+            referenceGeometry[2 + 2 * a] = dphi_dx[a][1];
+        }
+        referenceGeometry += 1 + 2 * numberOfNodes;
+    }
+}
+
+void PlaneElement::getLumpedMass(double *mass) const
+{
+    // Diagonal scaling (HRZ) of the consistent mass: positive for every element order, and density * area / 3 per
+    // node on the linear triangle, as in the lumped inertia of the element contributions
+    const unsigned int numberOfNodes = base_->getNodes().size();
+    double fractions[numberOfNodes];
+    const double elementMass = material_->getDensity() * getLumpedMassFractions(fractions);
+
+    const unsigned int ndofs = degreesOfFreedom_.size();
+    for (unsigned int i = 0; i < ndofs; i++)
+        mass[i] = 0.0;
+    for (unsigned int a = 0; a < numberOfNodes; a++)
+    {
+        mass[2 * a] = fractions[a] * elementMass;
+        mass[2 * a + 1] = mass[2 * a];
+    }
+}
+
+double PlaneElement::getLumpedMassFractions(double *fractions) const
+{
+    // Diagonal of the consistent mass normalized to a unit sum
+    const unsigned int numberOfNodes = base_->getNodes().size();
+    for (unsigned int a = 0; a < numberOfNodes; a++)
+        fractions[a] = 0.0;
+    double area = 0.0;
+    double diagonalSum = 0.0;
+    int q = -1;
+    for (QuadraturePoint *const &qp : base_->getParametricElement()->getQuadraturePoints())
+    {
+        q++;
+        double *phi = qp->getShapeFunctionsValues();
+
+        double factor1; // weight * j0
+        if (referenceGeometry_)
+            factor1 = referenceGeometry_[q * (1 + 2 * numberOfNodes)];
+        else
+        {
+            double dx_dxsi[2][2];
+            getReferenceJacobianMatrix(qp->getShapeFunctionsDerivativesValues(), dx_dxsi);
+            factor1 = qp->getWeight() * getMatrixDeterminant(dx_dxsi);
+        }
+
+        area += factor1;
+        for (unsigned int a = 0; a < numberOfNodes; a++)
+        {
+            fractions[a] += phi[a] * phi[a] * factor1;
+            diagonalSum += phi[a] * phi[a] * factor1;
+        }
+    }
+    for (unsigned int a = 0; a < numberOfNodes; a++)
+        fractions[a] /= diagonalSum;
+    return area;
+}
+
+bool PlaneElement::isBatchable() const
+{
+    // Batches are built for the Saint Venant-Kirchhoff solid, whose law is evaluated inline in every lane
+    if (material_->getType() != MaterialType::ELASTIC_SOLID && material_->getType() != MaterialType::ELASTIC_INCOMPRESSIBLE_SOLID)
+        return false;
+    const ElasticSolid *solid = dynamic_cast<const ElasticSolid *>(material_);
+    if (!solid || solid->getConstitutiveModel() != SAINT_VENANT_KIRCHHOFF)
+        return false;
+
+    switch (base_->getParametricElement()->getElementType())
+    {
+    case T3:
+    case T6:
+    case T10:
+    case Q4:
+    case Q9:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool PlaneElement::isBatchCompatible(const PlaneElement &element) const
+{
+    return element.material_ == material_ &&
+           element.degreesOfFreedom_.size() == degreesOfFreedom_.size() &&
+           element.getParametricElement()->getElementType() == getParametricElement()->getElementType() &&
+           element.referenceConfiguration_ == referenceConfiguration_;
+}
+
+void PlaneElement::elementContributionsBatch(const PlaneElement *const *elements,
+                                             const int &count,
+                                             int &ndofs1,
+                                             int &ndofs2,
+                                             int *indexes,
+                                             double *rhsValues,
+                                             double *hessianValues)
+{
+    const PlaneElement *first = elements[0];
+    const int ndofs = first->degreesOfFreedom_.size();
+    ndofs1 = 2 * first->base_->getNodes().size();
+    ndofs2 = ndofs - ndofs1;
+
+    for (int l = 0; l < count; l++)
+        for (int i = 0; i < ndofs; i++)
+            indexes[l * ndofs + i] = elements[l]->degreesOfFreedom_[i]->getIndex();
+
+    switch (first->getParametricElement()->getElementType())
+    {
+    case T3:
+        dispatchBatchFormulation<3>(elements, count, rhsValues, hessianValues);
+        break;
+    case T6:
+        dispatchBatchFormulation<6>(elements, count, rhsValues, hessianValues);
+        break;
+    case T10:
+        dispatchBatchFormulation<10>(elements, count, rhsValues, hessianValues);
+        break;
+    case Q4:
+        dispatchBatchFormulation<4>(elements, count, rhsValues, hessianValues);
+        break;
+    case Q9:
+        dispatchBatchFormulation<9>(elements, count, rhsValues, hessianValues);
+        break;
+    default:
+        for (int l = 0; l < count; l++)
+        {
+            int n1, n2;
+            elements[l]->elementContributions(n1, n2, indexes + l * ndofs, rhsValues + l * ndofs,
+                                              hessianValues ? hessianValues + l * ndofs * ndofs : nullptr);
+        }
+        break;
+    }
+}
+
+template <int NumberOfNodes>
+void PlaneElement::dispatchBatchFormulation(const PlaneElement *const *elements,
+                                            const int &count,
+                                            double *rhsValues,
+                                            double *hessianValues)
+{
+    const bool mixedFormulation = elements[0]->degreesOfFreedom_.size() > 2 * NumberOfNodes;
+    const bool lumpedMass = elements[0]->parameters_->useLumpedMass();
+
+    if (!hessianValues)
+    {
+        if (mixedFormulation)
+        {
+            if (lumpedMass)
+                computeBatchContributions<NumberOfNodes, true, true, false>(elements, count, rhsValues, hessianValues);
+            else
+                computeBatchContributions<NumberOfNodes, true, false, false>(elements, count, rhsValues, hessianValues);
+        }
+        else
+        {
+            if (lumpedMass)
+                computeBatchContributions<NumberOfNodes, false, true, false>(elements, count, rhsValues, hessianValues);
+            else
+                computeBatchContributions<NumberOfNodes, false, false, false>(elements, count, rhsValues, hessianValues);
+        }
+        return;
+    }
+
+    if (mixedFormulation)
+    {
+        if (lumpedMass)
+            computeBatchContributions<NumberOfNodes, true, true, true>(elements, count, rhsValues, hessianValues);
+        else
+            computeBatchContributions<NumberOfNodes, true, false, true>(elements, count, rhsValues, hessianValues);
+    }
+    else
+    {
+        if (lumpedMass)
+            computeBatchContributions<NumberOfNodes, false, true, true>(elements, count, rhsValues, hessianValues);
+        else
+            computeBatchContributions<NumberOfNodes, false, false, true>(elements, count, rhsValues, hessianValues);
+    }
+}
 
-                    hessianValues[ndofs * (ndofs1 + i) + ndofs1 + j] += -(dphi_dy[a][0] * dphi_dy[b][0] +
-                                                                          dphi_dy[a][1] * dphi_dy[b][1]) *
-                                                                        factor10;
+template <int NumberOfNodes, bool Mixed, bool LumpedMass, bool Hessian>
+void PlaneElement::computeBatchContributions(const PlaneElement *const *elements,
+                                             const int &count,
+                                             double *rhsValues,
+                                             double *hessianValues)
+{
+    // Same computation as computeContributions, with every quantity carrying one entry per lane (element).
+    // The innermost loops run over the lanes so that the 2x2 algebra is vectorized across elements.
+    constexpr int L = batchWidth;
+    constexpr int ndofs1 = 2 * NumberOfNodes;
+    constexpr int ndofs2 = Mixed ? NumberOfNodes : 0;
+    constexpr int ndofs = ndofs1 + ndofs2;
+
+    const PlaneElement *first = elements[0];
+
+    // Nodal values; lanes past count repeat the last element and are discarded
+    alignas(64) double x[NumberOfNodes][2][L];
+    alignas(64) double y[NumberOfNodes][2][L];
+    alignas(64) double accelN[NumberOfNodes][2][L];
+    alignas(64) double pN[NumberOfNodes][L];
+    for (int l = 0; l < L; l++)
+    {
+        const PlaneElement *el = elements[std::min(l, count - 1)];
+        const std::vector<Node *> &nodes = el->base_->getNodes();
+        for (int a = 0; a < NumberOfNodes; a++)
+        {
+            const DegreeOfFreedom *dof0 = nodes[a]->getDegreeOfFreedom(0);
+            const DegreeOfFreedom *dof1 = nodes[a]->getDegreeOfFreedom(1);
+            if (!el->referenceGeometry_)
+                switch (el->referenceConfiguration_)
+                {
+                case ReferenceConfiguration::INITIAL:
+                    x[a][0][l] = dof0->getInitialValue();
+                    x[a][1][l] = dof1->getInitialValue();
+                    break;
+                case ReferenceConfiguration::PAST:
+                    x[a][0][l] = dof0->getPastValue();
+                    x[a][1][l] = dof1->getPastValue();
+                    break;
+                case ReferenceConfiguration::CURRENT:
+                    std::cout << "Updated Lagrangian Formulation is not implemented on this version of the code.\n";
+                    exit(EXIT_FAILURE);
+                }
+            y[a][0][l] = dof0->getIntermediateValue();
+            y[a][1][l] = dof1->getIntermediateValue();
+            accelN[a][0][l] = dof0->getIntermediateSecondTimeDerivative();
+            accelN[a][1][l] = dof1->getIntermediateSecondTimeDerivative();
+            pN[a][l] = Mixed ? nodes[a]->getDegreeOfFreedom(2)->getCurrentValue() : 0.0;
+        }
+    }
+
+    const SaintVenantKirchhoffKernel svk(static_cast<const ElasticSolid *>(first->material_));
+    const double c11 = svk.c11, c12 = svk.c12, c33 = svk.c33;
+
+    AnalysisParameters *parameters = first->parameters_;
+    const double density = first->material_->getDensity();
+    const double *gravity = parameters->getGravity();
+    const double deltat = parameters->getDeltat();
+    const double alphaF = parameters->getAlphaF();
+    const double alphaM = parameters->getAlphaM();
+    const double beta = parameters->getBeta();
+    const double tpspg = (0.5 * deltat * deltat) / density;
+
+    // HRZ mass fractions of the nodes of every lane
+    alignas(64) double lumpedFractions[NumberOfNodes][L];
+    if (LumpedMass)
+        for (int l = 0; l < L; l++)
+        {
+            double fractions[NumberOfNodes];
+            elements[std::min(l, count - 1)]->getLumpedMassFractions(fractions);
+            for (int a = 0; a < NumberOfNodes; a++)
+                lumpedFractions[a][l] = fractions[a];
+        }
+
+    alignas(64) double rhs[ndofs][L] = {};
+    constexpr int hessianSize = Hessian ? ndofs : 1;
+    alignas(64) double hessian[hessianSize][hessianSize][L] = {};
+
+    // Elements of the same type share the quadrature data
+    const bool cached = first->referenceGeometry_ != nullptr;
+    constexpr int geometryStride = 1 + 2 * NumberOfNodes;
+    int q = -1;
+    for (QuadraturePoint *const &qp : first->getParametricElement()->getQuadraturePoints())
+    {
+        q++;
+        const double *phi = qp->getShapeFunctionsValues();
+
+        alignas(64) double factor1[L]; // weight * j0
+        alignas(64) double dphi_dx[NumberOfNodes][2][L];
+        if (cached)
+        {
+            for (int l = 0; l < L; l++)
+            {
+                const double *geometry = elements[std::min(l, count - 1)]->referenceGeometry_ + q * geometryStride;
+                factor1[l] = geometry[0];
+                for (int a = 0; a < NumberOfNodes; a++)
+                {
+                    dphi_dx[a][0][l] = geometry[1 + 2 * a];
+                    dphi_dx[a][1][l] = geometry[2 + 2 * a];
                 }
             }
         }
-    }    
+        else
+        {
+            double **dphi_dxsi = qp->getShapeFunctionsDerivativesValues();
+            const double weight = qp->getWeight();
+
+            // Reference jacobian and its inverse
+            alignas(64) double dx_dxsi[2][2][L] = {};
+            for (int a = 0; a < NumberOfNodes; a++)
+            {
+#pragma omp simd
+                for (int l = 0; l < L; l++)
+                {
+                    dx_dxsi[0][0][l] += dphi_dxsi[0][a] * x[a][0][l];
+                    dx_dxsi[0][1][l] += dphi_dxsi[1][a] * x[a][0][l];
+                    dx_dxsi[1][0][l] += dphi_dxsi[0][a] * x[a][1][l];
+                    dx_dxsi[1][1][l] += dphi_dxsi[1][a] * x[a][1][l];
+                }
+            }
+
+            alignas(64) double dxsi_dx[2][2][L];
+#pragma omp simd
+            for (int l = 0; l < L; l++)
+            {
+                const double j0 = dx_dxsi[0][0][l] * dx_dxsi[1][1][l] - dx_dxsi[0][1][l] * dx_dxsi[1][0][l];
+                const double inv = 1.0 / j0;
+                factor1[l] = weight * j0;
+                dxsi_dx[0][0][l] = dx_dxsi[1][1][l] * inv;
+                dxsi_dx[0][1][l] = -dx_dxsi[0][1][l] * inv;
+                dxsi_dx[1][0][l] = -dx_dxsi[1][0][l] * inv;
+                dxsi_dx[1][1][l] = dx_dxsi[0][0][l] * inv;
+            }
+
+            for (int a = 0; a < NumberOfNodes; a++)
+            {
+#pragma omp simd
+                for (int l = 0; l < L; l++)
+                {
+                    dphi_dx[a][0][l] = dphi_dxsi[0][a] * dxsi_dx[0][0][l] + dphi_dxsi[1][a] * dxsi_dx[1][0][l];
+                    dphi_dx[a][1][l] = dphi_dxsi[0][a] * dxsi_dx[0][1][l] + dphi_dxsi[1][a] * dxsi_dx[1][1][l];
+                }
+            }
+        }
+
+        // Deformation gradient
+        alignas(64) double dy_dx[2][2][L] = {};
+        for (int a = 0; a < NumberOfNodes; a++)
+        {
+#pragma omp simd
+            for (int l = 0; l < L; l++)
+            {
+                dy_dx[0][0][l] += dphi_dx[a][0][l] * y[a][0][l];
+                dy_dx[0][1][l] += dphi_dx[a][1][l] * y[a][0][l];
+                dy_dx[1][0][l] += dphi_dx[a][0][l] * y[a][1][l];
+                dy_dx[1][1][l] += dphi_dx[a][1][l] * y[a][1][l];
+            }
+        }
+
+        // Jacobian, inverse right Cauchy-Green tensor, Green-Lagrange strain and stress
+        alignas(64) double jacobian[L];
+        alignas(64) double dx_dy[2][2][L];
+        alignas(64) double CI[3][L];
+        alignas(64) double S[3][L];
+#pragma omp simd
+        for (int l = 0; l < L; l++)
+        {
+            jacobian[l] = dy_dx[0][0][l] * dy_dx[1][1][l] - dy_dx[0][1][l] * dy_dx[1][0][l];
+            const double inv = 1.0 / jacobian[l];
+            dx_dy[0][0][l] = dy_dx[1][1][l] * inv;
+            dx_dy[0][1][l] = -dy_dx[0][1][l] * inv;
+            dx_dy[1][0][l] = -dy_dx[1][0][l] * inv;
+            dx_dy[1][1][l] = dy_dx[0][0][l] * inv;
+
+            CI[0][l] = dx_dy[0][0][l] * dx_dy[0][0][l] + dx_dy[0][1][l] * dx_dy[0][1][l];
+            CI[1][l] = dx_dy[1][0][l] * dx_dy[1][0][l] + dx_dy[1][1][l] * dx_dy[1][1][l];
+            CI[2][l] = dx_dy[0][0][l] * dx_dy[1][0][l] + dx_dy[0][1][l] * dx_dy[1][1][l];
+
+            const double E0 = 0.5 * (dy_dx[0][0][l] * dy_dx[0][0][l] + dy_dx[1][0][l] * dy_dx[1][0][l]) - 0.5;
+            const double E1 = 0.5 * (dy_dx[0][1][l] * dy_dx[0][1][l] + dy_dx[1][1][l] * dy_dx[1][1][l]) - 0.5;
+            const double E2 = 0.5 * (dy_dx[0][0][l] * dy_dx[0][1][l] + dy_dx[1][0][l] * dy_dx[1][1][l]);
+            S[0][l] = c11 * E0 + c12 * E1;
+            S[1][l] = c11 * E1 + c12 * E0;
+            S[2][l] = c33 * E2;
+        }
+
+        alignas(64) double dE_dy[ndofs1][3][L];
+        alignas(64) double dS_dy[ndofs1][3][L];
+        for (int i = 0; i < ndofs1; i++)
+        {
+            const int a = i / 2;
+            const int j = i % 2;
+#pragma omp simd
+            for (int l = 0; l < L; l++)
+            {
+                dE_dy[i][0][l] = dphi_dx[a][0][l] * dy_dx[j][0][l];
+                dE_dy[i][1][l] = dphi_dx[a][1][l] * dy_dx[j][1][l];
+                dE_dy[i][2][l] = 0.5 * (dphi_dx[a][0][l] * dy_dx[j][1][l] + dy_dx[j][0][l] * dphi_dx[a][1][l]);
+                if (Hessian)
+                {
+                    dS_dy[i][0][l] = c11 * dE_dy[i][0][l] + c12 * dE_dy[i][1][l];
+                    dS_dy[i][1][l] = c11 * dE_dy[i][1][l] + c12 * dE_dy[i][0][l];
+                    dS_dy[i][2][l] = c33 * dE_dy[i][2][l];
+                }
+            }
+        }
+
+        // Acceleration, pressure and pressure gradient at the integration point
+        alignas(64) double accel[2][L] = {};
+        alignas(64) double pressure[L] = {};
+        alignas(64) double dp_dx[2][L] = {};
+        alignas(64) double dphi_dy[NumberOfNodes][2][L];
+        for (int a = 0; a < NumberOfNodes; a++)
+        {
+#pragma omp simd
+            for (int l = 0; l < L; l++)
+            {
+                if (!LumpedMass)
+                {
+                    accel[0][l] += phi[a] * accelN[a][0][l];
+                    accel[1][l] += phi[a] * accelN[a][1][l];
+                }
+                if (Mixed)
+                {
+                    dphi_dy[a][0][l] = dphi_dx[a][0][l] * dx_dy[0][0][l] + dphi_dx[a][1][l] * dx_dy[1][0][l];
+                    dphi_dy[a][1][l] = dphi_dx[a][0][l] * dx_dy[0][1][l] + dphi_dx[a][1][l] * dx_dy[1][1][l];
+                    pressure[l] += phi[a] * pN[a][l];
+                    dp_dx[0][l] += dphi_dy[a][0][l] * pN[a][l];
+                    dp_dx[1][l] += dphi_dy[a][1][l] * pN[a][l];
+                }
+            }
+        }
+
+        alignas(64) double factor2[L], factor3[L], factor4[L], factor5[L];
+#pragma omp simd
+        for (int l = 0; l < L; l++)
+        {
+            factor2[l] = alphaF * factor1[l];
+            factor3[l] = pressure[l] * jacobian[l];
+            factor4[l] = alphaM * density * factor1[l] / (beta * deltat * deltat);
+            factor5[l] = jacobian[l] * factor1[l];
+        }
+
+        // Position degrees of freedom
+        for (int i = 0; i < ndofs1; i++)
+        {
+            const int a = i / 2;
+            const int k = i % 2;
+
+            alignas(64) double CI_dE[L];
+#pragma omp simd
+            for (int l = 0; l < L; l++)
+            {
+                CI_dE[l] = CI[0][l] * dE_dy[i][0][l] + CI[1][l] * dE_dy[i][1][l] + 2.0 * CI[2][l] * dE_dy[i][2][l];
+                const double v = S[0][l] * dE_dy[i][0][l] + S[1][l] * dE_dy[i][1][l] + 2.0 * S[2][l] * dE_dy[i][2][l];
+                const double m = LumpedMass ? density * accelN[a][k][l] * lumpedFractions[a][l] : density * phi[a] * accel[k][l];
+                const double bf = LumpedMass ? density * gravity[k] * lumpedFractions[a][l] : density * phi[a] * gravity[k];
+                rhs[i][l] -= (v + m + factor3[l] * CI_dE[l] - bf) * factor1[l];
+            }
+
+            if (!Hessian)
+                continue;
+
+            for (int j = 0; j < ndofs1; j++)
+            {
+                const int b = j / 2;
+                const int kl = (k == j % 2);
+                const double lumped = (LumpedMass && i == j) ? 1.0 : 0.0;
+#pragma omp simd
+                for (int l = 0; l < L; l++)
+                {
+                    double value = (dE_dy[j][0][l] * dS_dy[i][0][l] + dE_dy[j][1][l] * dS_dy[i][1][l] + 2.0 * dE_dy[j][2][l] * dS_dy[i][2][l]) * factor2[l];
+                    if (LumpedMass)
+                        value += lumped * lumpedFractions[a][l] * factor4[l];
+                    if (kl)
+                    {
+                        const double d2E0 = dphi_dx[a][0][l] * dphi_dx[b][0][l];
+                        const double d2E1 = dphi_dx[a][1][l] * dphi_dx[b][1][l];
+                        const double d2E2 = 0.5 * (dphi_dx[a][0][l] * dphi_dx[b][1][l] + dphi_dx[b][0][l] * dphi_dx[a][1][l]);
+                        value += (S[0][l] * d2E0 + S[1][l] * d2E1 + 2.0 * S[2][l] * d2E2) * factor2[l];
+                        if (!LumpedMass)
+                            value += factor4[l] * phi[a] * phi[b];
+                    }
+                    hessian[i][j][l] += value;
+                }
+            }
+
+            for (int j = 0; j < ndofs2; j++)
+            {
+#pragma omp simd
+                for (int l = 0; l < L; l++)
+                    hessian[i][ndofs1 + j][l] += phi[j] * CI_dE[l] * factor5[l];
+            }
+        }
+
+        // Pressure degrees of freedom
+        for (int i = 0; i < ndofs2; i++)
+        {
+            const int a = i;
+#pragma omp simd
+            for (int l = 0; l < L; l++)
+            {
+                const double c = phi[a] * (jacobian[l] - 1.0);
+                const double bf_pspg = tpspg * density * (dphi_dy[a][0][l] * gravity[0] + dphi_dy[a][1][l] * gravity[1]);
+                const double p_pspg = tpspg * jacobian[l] * (dphi_dy[a][0][l] * dp_dx[0][l] + dphi_dy[a][1][l] * dp_dx[1][l]);
+                rhs[ndofs1 + i][l] -= (c - p_pspg - bf_pspg) * factor1[l];
+            }
+
+            if (!Hessian)
+                continue;
+
+            for (int j = 0; j < ndofs1; j++)
+            {
+#pragma omp simd
+                for (int l = 0; l < L; l++)
+                    hessian[ndofs1 + i][j][l] += phi[a] * (CI[0][l] * dE_dy[j][0][l] + CI[1][l] * dE_dy[j][1][l] + 2.0 * CI[2][l] * dE_dy[j][2][l]) *
+                                                 jacobian[l] * factor2[l];
+            }
+            for (int j = 0; j < ndofs2; j++)
+            {
+                const int b = j;
+#pragma omp simd
+                for (int l = 0; l < L; l++)
+                    hessian[ndofs1 + i][ndofs1 + j][l] -= (dphi_dy[a][0][l] * dphi_dy[b][0][l] + dphi_dy[a][1][l] * dphi_dy[b][1][l]) *
+                                                          tpspg * jacobian[l] * factor1[l];
+            }
+        }
+    }
+
+    // Lanes back to the row-major element blocks
+    for (int l = 0; l < count; l++)
+    {
+        double *elementRhs = rhsValues + l * ndofs;
+        double *elementHessian = Hessian ? hessianValues + l * ndofs * ndofs : nullptr;
+        for (int i = 0; i < ndofs; i++)
+        {
+            elementRhs[i] = rhs[i][l];
+            if (Hessian)
+                for (int j = 0; j < ndofs; j++)
+                    elementHessian[i * ndofs + j] = hessian[i][j][l];
+        }
+    }
 }
 
 void PlaneElement::clearNeighborElements()
@@ -338,19 +1124,31 @@ void PlaneElement::getCauchyStress(double **&nodalCauchyStress) const
         sum++;
 
         double *phi = qp->getShapeFunctionsValues();
-        double **dphi_dxsi = qp->getShapeFunctionsDerivativesValues();
-        double weight = qp->getWeight();
 
-        double dx_dxsi[2][2];
-        getReferenceJacobianMatrix(dphi_dxsi, dx_dxsi);
+        double dphi_dx[numberOfNodes][2];
+        if (referenceGeometry_)
+        {
+            const double *geometry = referenceGeometry_ + sum * (1 + 2 * numberOfNodes);
+            for (unsigned int a = 0; a < numberOfNodes; a++)
+            {
+                dphi_dx[a][0] = geometry[1 + 2 * a];
+                dphi_dx[a][1] = geometry[2 + 2 * a];
+            }
+        }
+        else
+        {
+            double **dphi_dxsi = qp->getShapeFunctionsDerivativesValues();
 
-        double j0 = getMatrixDeterminant(dx_dxsi);
+            double dx_dxsi[2][2];
+            getReferenceJacobianMatrix(dphi_dxsi, dx_dxsi);
 
-        double dxsi_dx[2][2];
-        getInverseMatrix(dx_dxsi, j0, dxsi_dx);
+            double j0 = getMatrixDeterminant(dx_dxsi);
 
-        double dphi_dx[numberOfNodes][2];
-        getReferenceShapeFunctionsGradient(dphi_dxsi, dxsi_dx, dphi_dx);
+            double dxsi_dx[2][2];
+            getInverseMatrix(dx_dxsi, j0, dxsi_dx);
+
+            getReferenceShapeFunctionsGradient(dphi_dxsi, dxsi_dx, dphi_dx);
+        }
 
         double dy_dx[2][2];
         getDeformationGradient(dphi_dx, dy_dx);
@@ -793,21 +1591,37 @@ void PlaneElement::getEnergy(double &deformationEnergy,
     kinectEnergy = 0.0;
     domainForcePotentialEnergy = 0.0;
 
+    const double *cachedGeometry = referenceGeometry_;
     for (auto &sqp : spatialQuadraturePoints)
     {
         double *phi = sqp->getShapeFunctionsValues();
-        double **dphi_dxsi = sqp->getShapeFunctionsDerivativesValues();
-        double spaceWeight = sqp->getWeight();
 
-        double dx_dxsi[2][2];
-        getReferenceJacobianMatrix(dphi_dxsi, dx_dxsi);
-        double j0 = getMatrixDeterminant(dx_dxsi);
+        double factor; // weight * j0
+        double dphi_dx[numberOfNodes][2];
+        if (cachedGeometry)
+        {
+            factor = cachedGeometry[0];
+            for (unsigned int a = 0; a < numberOfNodes; a++)
+            {
+                dphi_dx[a][0] = cachedGeometry[1 + 2 * a];
+                dphi_dx[a][1] = cachedGeometry[2 + 2 * a];
+            }
+            cachedGeometry += 1 + 2 * numberOfNodes;
+        }
+        else
+        {
+            double **dphi_dxsi = sqp->getShapeFunctionsDerivativesValues();
 
-        double dxsi_dx[2][2];
-        getInverseMatrix(dx_dxsi, j0, dxsi_dx);
+            double dx_dxsi[2][2];
+            getReferenceJacobianMatrix(dphi_dxsi, dx_dxsi);
+            double j0 = getMatrixDeterminant(dx_dxsi);
 
-        double dphi_dx[numberOfNodes][2];
-        getReferenceShapeFunctionsGradient(dphi_dxsi, dxsi_dx, dphi_dx);
+            double dxsi_dx[2][2];
+            getInverseMatrix(dx_dxsi, j0, dxsi_dx);
+
+            getReferenceShapeFunctionsGradient(dphi_dxsi, dxsi_dx, dphi_dx);
+            factor = sqp->getWeight() * j0;
+        }
 
         double dy_dx[2][2];
         getCurrentDeformationGradient(dphi_dx, dy_dx);
@@ -835,8 +1649,6 @@ void PlaneElement::getEnergy(double &deformationEnergy,
             break;
         }
 
-        const double factor = spaceWeight * j0;
-
         // Deformation energy
         deformationEnergy += 0.5 * doubleContraction(S, E) * factor;
 
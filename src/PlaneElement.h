@@ -38,14 +38,43 @@ class PlaneElement : public Element
 
     void elementContributions(int& ndofs1,
                               int& ndofs2,
-                              int*& indexes,
-                              double*& rhsValues,
-                              double*& hessianValues) const override;
+                              int* indexes,
+                              double* rhsValues,
+                              double* hessianValues) const override;
+
+    // Number of same-type elements evaluated together by elementContributionsBatch, one per SIMD lane
+#if defined(__AVX512F__)
+    static constexpr int batchWidth = 8;
+#elif defined(__AVX2__)
+    static constexpr int batchWidth = 4;
+#else
+    static constexpr int batchWidth = 1;
+#endif
+
+    bool isBatchable() const;
+
+    bool isBatchCompatible(const PlaneElement& element) const;
+
+    // Contributions of up to batchWidth compatible elements; the outputs of element l start at
+    // indexes + l * ndofs, rhsValues + l * ndofs and hessianValues + l * ndofs * ndofs
+    static void elementContributionsBatch(const PlaneElement* const* elements,
+                                          const int& count,
+                                          int& ndofs1,
+                                          int& ndofs2,
+                                          int* indexes,
+                                          double* rhsValues,
+                                          double* hessianValues);
 
     void getEnergy(double &deformationEnergy,
                    double &kinectEnergy,
                    double &domainForcePotentialEnergy) const override;
 
+    int getReferenceGeometrySize() const override;
+
+    void computeReferenceGeometry(double* referenceGeometry) const override;
+
+    void getLumpedMass(double* mass) const override;
+
     void clearNeighborElements() override;
 
     inline void getReferenceJacobianMatrix(double** dphi_dxsi,
@@ -108,6 +137,35 @@ class PlaneElement : public Element
     inline double computeStabilizationParameter() const;
 
     private:
+    // HRZ share of the element mass lumped on every node (1/3 on the linear triangle); returns the reference area
+    double getLumpedMassFractions(double* fractions) const;
+
+    template <int NumberOfNodes>
+    void dispatchConstitutiveModel(double* rhsValues,
+                                   double* hessianValues) const;
+
+    template <int NumberOfNodes, class ConstitutiveKernel>
+    void dispatchFormulation(const ConstitutiveKernel& constitutive,
+                             double* rhsValues,
+                             double* hessianValues) const;
+
+    template <int NumberOfNodes, bool Mixed, bool LumpedMass, bool Hessian, class ConstitutiveKernel>
+    void computeContributions(const ConstitutiveKernel& constitutive,
+                              double* rhsValues,
+                              double* hessianValues) const;
+
+    template <int NumberOfNodes>
+    static void dispatchBatchFormulation(const PlaneElement* const* elements,
+                                         const int& count,
+                                         double* rhsValues,
+                                         double* hessianValues);
+
+    template <int NumberOfNodes, bool Mixed, bool LumpedMass, bool Hessian>
+    static void computeBatchContributions(const PlaneElement* const* elements,
+                                          const int& count,
+                                          double* rhsValues,
+                                          double* hessianValues);
+
     Material* material_;
     BaseSurfaceElement* base_;
     AnalysisParameters* parameters_;
@@ -1,5 +1,11 @@
 #include "SolidDomain.h"
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 static std::vector<std::string> split(std::string &str)
 {
@@ -24,15 +30,37 @@ SolidDomain::SolidDomain(Geometry *geometry, const int &index)
 	  parameters_(new AnalysisParameters()),
 	  geometry_(geometry),
 	  remesh_(nullptr),
-	  perm_(nullptr)
+	  perm_(nullptr),
+	  assemblyTime_(0.0),
+	  stateUpdateTime_(0.0),
+	  stateUpdates_(0),
+	  systemPatternOutdated_(true),
+	  firstOwnedRow_(0),
+	  numberOfOwnedRows_(0),
+	  linearSolverProfile_(SolverProfile::DEFAULT),
+	  matrixFreeInput_(nullptr),
+	  matrixFreeOutput_(nullptr),
+	  matrixFreeProducts_(0),
+	  matrixFreeTime_(0.0),
+	  outputQueue_(nullptr),
+	  xdmfWriter_(nullptr),
+	  timeSeries_(nullptr)
 {
 	int fail = system("mkdir -p ./results");
-	fail = system("rm ./results/*.vtu 2> /dev/null");
+	fail = system("rm ./results/*.vtu ./results/*.pvtu ./results/*.h5 ./results/*.xmf 2> /dev/null");
 	int fail2 = system("mkdir -p ./plotData");
-	fail2 = system("rm ./plotData/*.dat 2> /dev/null");
+	fail2 = system("rm ./plotData/*.dat ./plotData/*.bin 2> /dev/null");
 }
 
-SolidDomain::~SolidDomain() {}
+SolidDomain::~SolidDomain()
+{
+	writeTimeSeries();
+	delete outputQueue_;
+#ifdef HAVE_HDF5
+	delete xdmfWriter_;
+#endif
+	delete timeSeries_;
+}
 
 void SolidDomain::setNumberOfSteps(const int numberOfSteps)
 {
@@ -101,10 +129,111 @@ void SolidDomain::setLumpedMass(const bool &useLumpedMass)
 	parameters_->setLumpedMass(useLumpedMass);
 }
 
+void SolidDomain::setNumberOfThreads(const int &numberOfThreads)
+{
+	parameters_->setNumberOfThreads(numberOfThreads);
+}
+
 void SolidDomain::setReferenceConfiguration(const ReferenceConfiguration reference)
 {
 	for (Element *&el : elements_)
 		el->setReferenceConfiguration(reference);
+	buildReferenceGeometryCache(reference);
+}
+
+void SolidDomain::setReferenceGeometryCache(const bool &useCache)
+{
+	parameters_->setReferenceGeometryCache(useCache);
+}
+
+void SolidDomain::setSolverProfile(const SolverProfile &profile)
+{
+	parameters_->setSolverProfile(profile);
+}
+
+void SolidDomain::setMatrixFree(const bool &useMatrixFree)
+{
+	parameters_->setMatrixFree(useMatrixFree);
+}
+
+void SolidDomain::setArcLength(const bool &useArcLength, const double &initialArcLength, const int &desiredIterations,
+							   const double &loadScaling, const int &maxSteps)
+{
+	parameters_->setArcLength(useArcLength);
+	parameters_->setInitialArcLength(initialArcLength);
+	parameters_->setArcLengthIterations(desiredIterations);
+	parameters_->setArcLengthScaling(loadScaling);
+	parameters_->setMaxArcLengthSteps(maxSteps);
+}
+
+void SolidDomain::setGlobalization(const Globalization &globalization, const int &maxLineSearchIterations)
+{
+	parameters_->setGlobalization(globalization);
+	parameters_->setMaxLineSearchIterations(maxLineSearchIterations);
+}
+
+void SolidDomain::setModifiedNewton(const bool &useModifiedNewton, const int &maxFactorizationReuses, const double &refactorizationContraction)
+{
+	parameters_->setModifiedNewton(useModifiedNewton);
+	parameters_->setMaxFactorizationReuses(maxFactorizationReuses);
+	parameters_->setRefactorizationContraction(refactorizationContraction);
+}
+
+void SolidDomain::setExplicitCourantNumber(const double &courantNumber)
+{
+	parameters_->setExplicitCourantNumber(courantNumber);
+}
+
+void SolidDomain::setParaviewFormat(const VTUFormat &format)
+{
+	parameters_->setParaviewFormat(format);
+}
+
+void SolidDomain::setResultsFormat(const ResultsFormat &format)
+{
+#ifndef HAVE_HDF5
+	if (format == ResultsFormat::XDMF)
+	{
+		PetscPrintf(PETSC_COMM_WORLD, "Built without HDF5, the results are written as .vtu files.\n");
+		return;
+	}
+#endif
+	parameters_->setResultsFormat(format);
+}
+
+void SolidDomain::setAsynchronousOutput(const bool &asynchronousOutput, const int &outputSnapshots)
+{
+	parameters_->setAsynchronousOutput(asynchronousOutput);
+	parameters_->setOutputSnapshots(outputSnapshots);
+}
+
+void SolidDomain::setTimeSeriesOutput(const int &bufferedRows, const bool &binary)
+{
+	parameters_->setTimeSeriesBufferRows(bufferedRows);
+	parameters_->setBinaryTimeSeries(binary);
+}
+
+void SolidDomain::setPredictor(const Predictor &predictor, const int &extrapolationSteps)
+{
+	parameters_->setPredictor(predictor);
+	parameters_->setExtrapolationSteps(extrapolationSteps);
+}
+
+void SolidDomain::setConvergenceCriterion(const ConvergenceCriterion &criterion, const double &residualTolerance)
+{
+	parameters_->setConvergenceCriterion(criterion);
+	parameters_->setResidualTolerance(residualTolerance);
+}
+
+void SolidDomain::setAdaptiveTimeStepping(const double &errorTolerance, const double &initialDeltat, const double &minDeltat, const double &maxDeltat,
+										  const double &maxGrowth, const double &minShrink)
+{
+	parameters_->setErrorTolerance(errorTolerance);
+	parameters_->setInitialDeltat(initialDeltat);
+	parameters_->setMinDeltat(minDeltat);
+	parameters_->setMaxDeltat(maxDeltat);
+	parameters_->setMaxTimeStepGrowth(maxGrowth);
+	parameters_->setMinTimeStepShrink(minShrink);
 }
 
 void SolidDomain::addGraphic(std::string fileName, Variable variable, ConstrainedDOF direction, std::string pointName)
@@ -215,6 +344,9 @@ void SolidDomain::generateMesh(const PartitionOfUnity &elementType, const MeshAl
 
 	reorderDOFs();
 	domainDecomposition();
+	elementColoring();
+	buildReferenceGeometryCache(ReferenceConfiguration::PAST);
+	systemPatternOutdated_ = true; // any remeshing (e.g. TriangularMesher::execute) must also flag the pattern
 	PetscPrintf(PETSC_COMM_WORLD, "...Ending the Pre-processing Procedures...\n");
 }
 
@@ -222,15 +354,24 @@ void SolidDomain::solveTransientProblem()
 {
 	auto start_timer = std::chrono::high_resolution_clock::now();
 
+	// The error estimate of the adaptive time stepping is proportional to beta - 1/6
+	if (parameters_->getErrorTolerance() > 0.0 && std::fabs(parameters_->getBeta() - 1.0 / 6.0) < 1.0e-12)
+	{
+		PetscPrintf(PETSC_COMM_WORLD, "Adaptive time stepping cannot estimate the error of the Newmark scheme with beta = 1/6\n");
+		exit(EXIT_FAILURE);
+	}
+
+	assemblyTime_ = 0.0;
+	stateUpdateTime_ = 0.0;
+	stateUpdates_ = 0;
 	setReferenceConfiguration(ReferenceConfiguration::INITIAL);
 	if (parameters_->getInitialAccel())
 		computeInitialAccel();
 
 	// Petsc variables
-	Mat tangent;
+	Mat tangent, preconditioner = nullptr;
 	Vec rhs, solution;
 	KSP ksp;
-	PC pc;
 	PetscLogDouble bytes = 0.0;
 	PetscBool isbjacobi;
 
@@ -264,38 +405,123 @@ void SolidDomain::solveTransientProblem()
 	double *externalForces;
 	getExternalForces(ndofsForces, dofsForces, externalForces);
 
-	KSPCreate(PETSC_COMM_WORLD, &ksp);
-	KSPSetType(ksp, KSPFGMRES);
-	KSPSetTolerances(ksp, 1.0e-8, PETSC_DEFAULT, PETSC_DEFAULT, 100);
-	KSPGMRESSetRestart(ksp, 100);
-	KSPGetPC(ksp, &pc);
-	//PCSetType(pc, PCBJACOBI);
-	// KSPSetType(ksp, KSPPREONLY);
-	// KSPGetPC(ksp, &pc);
-	 PCSetType(pc, PCLU);
-
-	createSystemMatrix(tangent);
+	// The matrix-free tangent trades the stored matrix for one element pass per Krylov iteration, the linear solver
+	// being preconditioned by the assembled vertex part of the tangent
+	const bool matrixFree = parameters_->useMatrixFree();
+	std::vector<double> constrainedZeros(numberOfConstrainedDOFs, 0.0);
+	if (matrixFree)
+	{
+		PetscPrintf(PETSC_COMM_WORLD, "Matrix-free tangent (experimental): each Krylov iteration re-evaluates the element tangents\n");
+		createMatrixFreeTangent(tangent, preconditioner, numberOfConstrainedDOFs, constrainedDOFs);
+	}
+	else
+		createSystemMatrix(tangent);
 
 	// Create PETSc vectors
-	VecCreate(PETSC_COMM_WORLD, &rhs);
-	VecSetSizes(rhs, PETSC_DECIDE, numberOfBlockedDOFs_);
-	VecSetFromOptions(rhs);
-	VecDuplicate(rhs, &solution);
+	createSystemVectors(rhs, solution);
+
+	KSPCreate(PETSC_COMM_WORLD, &ksp);
+	configureLinearSolver(ksp, matrixFree ? SolverProfile::FGMRES_BJACOBI : SolverProfile::FGMRES_LU, matrixFree);
+
+	// Globalization of the Newton step: the residual alone is evaluated at the trial step lengths
+	const Globalization globalization = parameters_->getGlobalization();
+	Vec residual, increment;
+	double trustRadius = 0.0;
+	auto refreshVariables = [this]()
+	{
+		computeCurrentVariables();
+		computeIntermediateVariables();
+	};
+	auto computeResidual = [&](Vec &vec)
+	{
+		VecZeroEntries(vec);
+		applyNeummanConditions(vec, tangent, ndofsForces, dofsForces, externalForces, 1.0);
+		assembleResidual(vec);
+		VecSetValues(vec, numberOfConstrainedDOFs, constrainedDOFs, constrainedZeros.data(), INSERT_VALUES);
+		VecAssemblyBegin(vec);
+		VecAssemblyEnd(vec);
+	};
+	if (globalization != Globalization::FULL_STEP)
+	{
+		VecDuplicate(rhs, &residual);
+		VecDuplicate(solution, &increment);
+	}
 
 	const int numberOfSteps = parameters_->getNumberOfSteps();
 	const int maxNonlinearIterations = parameters_->getMaxNonlinearIterations();
 	const double nonlinearTolerance = parameters_->getNonlinearTolerance();
 
-	if (rank == 0)
+	// Residual criteria are checked right after the assembly, so a converged iteration skips the solve
+	const bool residualCriterion = parameters_->getConvergenceCriterion() != ConvergenceCriterion::POSITION_INCREMENT;
+	double referenceResidual = 0.0, referenceEnergy = 0.0;
+
+	// Predictor of the Newton initial guess; the constrained dofs keep their prescribed values
+	const Predictor predictor = parameters_->getPredictor();
+	const int extrapolationSteps = std::max(parameters_->getExtrapolationSteps(), 1);
+	const char *predictorNames[] = {"previous step", "constant velocity", "constant acceleration", "extrapolation"};
+	std::vector<char> constrainedRows(localDOFs_.size(), 0);
+	for (int i = 0; i < numberOfConstrainedDOFs; i++)
 	{
-		exportGraphicData(0);
-		exportToParaview(0);
+		const int row = getLocalRow(constrainedDOFs[i]);
+		if (row >= 0)
+			constrainedRows[row] = 1;
 	}
-
-	for (int timeStep = 0; timeStep < numberOfSteps; timeStep++)
+	std::vector<std::vector<double>> positionHistory;
+	std::vector<double> historyTimes;
+	auto recordPositions = [&](const double &t)
+	{
+		if (predictor != Predictor::EXTRAPOLATION)
+			return;
+		if ((int)positionHistory.size() == extrapolationSteps)
+		{
+			positionHistory.erase(positionHistory.begin());
+			historyTimes.erase(historyTimes.begin());
+		}
+		std::vector<double> positions(localDOFs_.size());
+		for (unsigned int i = 0; i < localDOFs_.size(); i++)
+			positions[i] = localDOFs_[i]->getCurrentValue();
+		positionHistory.push_back(positions);
+		historyTimes.push_back(t);
+	};
+
+	// Modified Newton: the LU factorization of an earlier tangent preconditions the current one (the Krylov solver
+	// corrects the difference) until it has been reused too many times or the Newton contraction degrades
+	const bool modifiedNewton = parameters_->useModifiedNewton();
+	const int maxFactorizationReuses = parameters_->getMaxFactorizationReuses();
+	const double refactorizationContraction = parameters_->getRefactorizationContraction();
+	int factorizationReuses = 0;
+	bool refactorize = true;
+	int totalIterations = 0;
+	int totalFactorizations = 0;
+
+	// Adaptive time stepping: the Newmark predictor-corrector difference estimates the local truncation error
+	// (Zienkiewicz-Xie), rejected steps are re-solved with a smaller deltat and the run covers the same final time
+	const double errorTolerance = parameters_->getErrorTolerance();
+	const bool adaptive = errorTolerance > 0.0;
+	const double finalTime = parameters_->getDeltat() * (double)numberOfSteps;
+	// Without a given minimum, deltat may shrink down to a millionth of its initial value
+	const double minDeltat = (parameters_->getMinDeltat() > 0.0) ? parameters_->getMinDeltat() : 1.0e-6 * parameters_->getInitialDeltat();
+	const double maxDeltat = parameters_->getMaxDeltat();
+	const double maxGrowth = parameters_->getMaxTimeStepGrowth();
+	const double minShrink = parameters_->getMinTimeStepShrink();
+	const double errorConstant = std::fabs(parameters_->getBeta() - 1.0 / 6.0) / parameters_->getBeta();
+	double time = 0.0;
+	int rejectedSteps = 0;
+	if (adaptive)
+		parameters_->setDeltat(parameters_->getInitialDeltat());
+	recordPositions(0.0);
+	int acceptedSteps = 0;
+
+	exportGraphicData(0.0);
+	exportToParaview(0);
+
+	for (int timeStep = 0; adaptive ? (time < finalTime * (1.0 - 1.0e-12)) : (timeStep < numberOfSteps); timeStep++)
 	{
-		PetscPrintf(PETSC_COMM_WORLD, "\n----------------------- TIME STEP = %d, time = %f  -----------------------\n\n", timeStep + 1, (double)(timeStep + 1) * parameters_->getDeltat());
-		parameters_->setCurrentTime(parameters_->getDeltat() * (double)(timeStep + 1));
+		if (adaptive && time + parameters_->getDeltat() > finalTime)
+			parameters_->setDeltat(finalTime - time);
+		const double deltat = parameters_->getDeltat();
+		PetscPrintf(PETSC_COMM_WORLD, "\n----------------------- TIME STEP = %d, time = %f  -----------------------\n\n", timeStep + 1, time + deltat);
+		parameters_->setCurrentTime(time + deltat);
 		double modelVolume = 0.0;
 		for (Element *const &el : elements_)
 		{
@@ -304,52 +530,446 @@ void SolidDomain::solveTransientProblem()
 		parameters_->setModelVolume(modelVolume);
 
 		setPastVariables();
+		predictPositions(constrainedRows, positionHistory, historyTimes, time + deltat);
 		computeCurrentVariables();
 		computeIntermediateVariables();
+		attachNearNullSpace(matrixFree ? preconditioner : tangent, ksp);
 		double positionNorm, pressureNorm;
+		double previousPositionNorm = 0.0;
+		int stepIterations = 0;
+		int stepFactorizations = 0;
+		bool converged = false;
 
 		// Newton-Raphson loop
 		for (int iteration = 0; (iteration < maxNonlinearIterations); iteration++)
 		{
 			applyNeummanConditions(rhs, tangent, ndofsForces, dofsForces, externalForces, 1.0);
-			assembleTransientLinearSystem(tangent, rhs);
-			MatZeroRowsColumns(tangent, numberOfConstrainedDOFs, constrainedDOFs, 1.0, solution, rhs);
-			MatView(tangent, PETSC_VIEWER_DRAW_WORLD);
-			solveLinearSystem(ksp, tangent, rhs, solution);
+			if (matrixFree)
+			{
+				assembleResidual(rhs, preconditioner);
+				MatZeroRowsColumns(preconditioner, numberOfConstrainedDOFs, constrainedDOFs, 1.0, nullptr, nullptr);
+				VecSetValues(rhs, numberOfConstrainedDOFs, constrainedDOFs, constrainedZeros.data(), INSERT_VALUES);
+				VecAssemblyBegin(rhs);
+				VecAssemblyEnd(rhs);
+			}
+			else
+			{
+				assembleTransientLinearSystem(tangent, rhs);
+				MatZeroRowsColumns(tangent, numberOfConstrainedDOFs, constrainedDOFs, 1.0, solution, rhs);
+				MatView(tangent, PETSC_VIEWER_DRAW_WORLD);
+			}
+			if (residualCriterion && checkResidualConvergence(rhs, solution, iteration, referenceResidual, referenceEnergy))
+			{
+				if (!matrixFree)
+					MatZeroEntries(tangent);
+				VecZeroEntries(rhs);
+				converged = true;
+				break;
+			}
+			if (modifiedNewton)
+			{
+				if (factorizationReuses >= maxFactorizationReuses)
+				{
+					PetscPrintf(PETSC_COMM_WORLD, "Modified Newton: refactorizing the tangent after %d reuses\n", factorizationReuses);
+					refactorize = true;
+				}
+				KSPSetReusePreconditioner(ksp, refactorize ? PETSC_FALSE : PETSC_TRUE);
+				if (refactorize)
+				{
+					factorizationReuses = 0;
+					stepFactorizations++;
+				}
+				else
+					factorizationReuses++;
+				refactorize = false;
+			}
+			if (solveLinearSystem(ksp, tangent, rhs, solution, preconditioner))
+			{
+				factorizationReuses = 0;
+				stepFactorizations++;
+			}
 			updateVariables(solution, positionNorm, pressureNorm);
 			computeCurrentVariables();
 			computeIntermediateVariables();
+			if (globalization != Globalization::FULL_STEP)
+			{
+				// The accepted increment is the Newton step scaled by the globalization
+				const double alpha = globalizeNewtonStep(rhs, solution, residual, increment, computeResidual, refreshVariables, trustRadius);
+				VecScale(solution, alpha);
+				positionNorm *= alpha;
+				pressureNorm *= alpha;
+			}
+			if (residualCriterion && iteration == 0)
+			{
+				VecDot(solution, rhs, &referenceEnergy);
+				referenceEnergy = std::fabs(referenceEnergy);
+			}
+			stepIterations++;
+
+			if (modifiedNewton && iteration > 0 && positionNorm > refactorizationContraction * previousPositionNorm)
+			{
+				PetscPrintf(PETSC_COMM_WORLD, "Modified Newton: contraction %E above %E at iteration %d, refactorizing the tangent\n",
+							positionNorm / previousPositionNorm, refactorizationContraction, iteration);
+				refactorize = true;
+			}
+			previousPositionNorm = positionNorm;
 
 			// PetscMemoryGetCurrentUsage(&bytes);
 			// PetscPrintf(PETSC_COMM_WORLD, "Newton iteration: %d - L2 Position Norm: %E - L2 Pressure Norm: %E\nMemory used by each processor: %f Mb\n",
 			// 			iteration, positionNorm / initialPositionNorm, pressureNorm, bytes / (1024 * 1024));
 
-			MatZeroEntries(tangent);
+			if (!matrixFree)
+				MatZeroEntries(tangent);
 			VecZeroEntries(rhs);
 
-			if (positionNorm / initialPositionNorm <= nonlinearTolerance)
+			if (!residualCriterion && positionNorm / initialPositionNorm <= nonlinearTolerance)
+			{
+				converged = true;
 				break;
+			}
+		}
+		totalIterations += stepIterations;
+		totalFactorizations += stepFactorizations;
+		if (modifiedNewton)
+			PetscPrintf(PETSC_COMM_WORLD, "Newton iterations: %d (predictor: %s) - Factorizations: %d\n", stepIterations, predictorNames[(int)predictor], stepFactorizations);
+		else
+			PetscPrintf(PETSC_COMM_WORLD, "Newton iterations: %d (predictor: %s)\n", stepIterations, predictorNames[(int)predictor]);
+
+		if (adaptive)
+		{
+			// u(n+1) - (u(n) + dt v(n) + dt^2/2 a(n)) = beta dt^2 (a(n+1) - a(n)) over the owned position rows, relative
+			// to the displacement of the step. Steps moving less than a millionth of the model size per dof are measured
+			// against that floor, so that the error of a body at rest does not blow up.
+			const DOFType *type = dofStore_.getTypes();
+			const double *current = dofStore_.getCurrentValues();
+			const double *past = dofStore_.getPastValues();
+			const double *pastVel = dofStore_.getPastFirstTimeDerivatives();
+			const double *pastAccel = dofStore_.getPastSecondTimeDerivatives();
+			double localSums[3] = {0.0, 0.0, 0.0}; // error, step displacement and number of position rows
+			for (int i = 0; i < numberOfOwnedRows_; i++)
+			{
+				const int k = firstOwnedRow_ + i;
+				if (type[k] == DOFType::POSITION)
+				{
+					const double difference = current[k] - past[k] - deltat * pastVel[k] - 0.5 * deltat * deltat * pastAccel[k];
+					localSums[0] += difference * difference;
+					localSums[1] += (current[k] - past[k]) * (current[k] - past[k]);
+					localSums[2] += 1.0;
+				}
+			}
+			double sums[3];
+			MPI_Allreduce(localSums, sums, 3, MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);
+			const double minDisplacementNorm = 1.0e-6 * pow(modelVolume, 1.0 / dimension_) * sqrt(sums[2]);
+			const double error = errorConstant * sqrt(sums[0]) / std::max(sqrt(sums[1]), minDisplacementNorm);
+
+			if (!converged || error > errorTolerance)
+			{
+				double newDeltat = deltat * (converged ? std::max(minShrink, 0.9 * std::cbrt(errorTolerance / error)) : minShrink);
+				if (newDeltat < minDeltat)
+				{
+					if (deltat <= minDeltat)
+					{
+						PetscPrintf(PETSC_COMM_WORLD, "Adaptive time stepping: step rejected at the minimum deltat %E (%s, error %E) at time %E\n",
+									deltat, converged ? "converged" : "not converged", error, time);
+						flushOutput();
+						exit(EXIT_FAILURE);
+					}
+					newDeltat = minDeltat;
+				}
+				PetscPrintf(PETSC_COMM_WORLD, "Adaptive time stepping: step rejected (%s, error %E) - deltat %E -> %E\n",
+							converged ? "converged" : "not converged", error, deltat, newDeltat);
+				restorePastVariables();
+				parameters_->setDeltat(newDeltat);
+				refactorize = true;
+				rejectedSteps++;
+				timeStep--;
+				continue;
+			}
+
+			// Growth is held back when Newton needed most of its iterations
+			double factor = (error > 0.0) ? 0.9 * std::cbrt(errorTolerance / error) : maxGrowth;
+			factor = std::min(maxGrowth, std::max(minShrink, factor));
+			if (factor > 1.0 && stepIterations >= 0.75 * maxNonlinearIterations)
+				factor = 1.0;
+			double newDeltat = std::max(minDeltat, deltat * factor);
+			if (maxDeltat > 0.0)
+				newDeltat = std::min(maxDeltat, newDeltat);
+			PetscPrintf(PETSC_COMM_WORLD, "Adaptive time stepping: error %E - next deltat %E\n", error, newDeltat);
+			time += deltat;
+			parameters_->setDeltat(newDeltat);
+			// The element matrices depend on deltat: a reused factorization would be of a different tangent
+			if (newDeltat != deltat)
+				refactorize = true;
 		}
+		else
+			time += deltat;
+		recordPositions(time);
+		acceptedSteps++;
 
 		// export results to paraview
-		if (rank == 0 && ((timeStep + 1) % parameters_->getExportFrequency() == 0))
+		if ((timeStep + 1) % parameters_->getExportFrequency() == 0)
 		{
 			computeCauchyStress();
-			exportGraphicData(timeStep + 1);
+			exportGraphicData(time);
 			exportToParaview(timeStep + 1);
 		}
 	}
+	flushOutput();
 	delete[] constrainedDOFs;
 	delete[] externalForces;
 	KSPDestroy(&ksp);
 	VecDestroy(&rhs);
 	VecDestroy(&solution);
 	MatDestroy(&tangent);
+	if (matrixFree)
+	{
+		MatDestroy(&preconditioner);
+		VecDestroy(&matrixFreeInput_);
+		VecDestroy(&matrixFreeOutput_);
+	}
+	if (globalization != Globalization::FULL_STEP)
+	{
+		VecDestroy(&residual);
+		VecDestroy(&increment);
+	}
 
 	auto end_timer = std::chrono::high_resolution_clock::now();
 	std::chrono::duration<double> elapsed = end_timer - start_timer;
 
 	PetscPrintf(PETSC_COMM_WORLD, "Solid Analysis Done. Elapsed time: %f\n", elapsed.count());
+	PetscPrintf(PETSC_COMM_WORLD, "Time spent assembling linear systems: %f\n", assemblyTime_);
+	PetscPrintf(PETSC_COMM_WORLD, "Time spent updating the dof state (past, current and intermediate variables): %f - %.2f ns per dof and update\n",
+				stateUpdateTime_, 1.0e9 * stateUpdateTime_ / std::max(1.0, (double)dofStore_.getSize() * stateUpdates_));
+	PetscPrintf(PETSC_COMM_WORLD, "Total Newton iterations: %d - %.2f per accepted step (predictor: %s)\n", totalIterations,
+				(double)totalIterations / std::max(acceptedSteps, 1), predictorNames[(int)predictor]);
+	if (modifiedNewton)
+		PetscPrintf(PETSC_COMM_WORLD, "Total factorizations: %d\n", totalFactorizations);
+	if (adaptive)
+		PetscPrintf(PETSC_COMM_WORLD, "Rejected time steps: %d\n", rejectedSteps);
+	if (matrixFree)
+		PetscPrintf(PETSC_COMM_WORLD, "Matrix-free tangent products: %d - Time spent: %f\n", matrixFreeProducts_, matrixFreeTime_);
+}
+
+void SolidDomain::solveExplicitProblem()
+{
+	// Central difference scheme with the lumped mass: only the internal forces are evaluated, no matrix is built.
+	// The analysis covers deltat * numberOfSteps with the stable step; deltat sets the output interval.
+	auto start_timer = std::chrono::high_resolution_clock::now();
+
+	// Every rank holds the whole element list, so all of them reach the same verdict before any collective call
+	const char *unsupported = nullptr;
+	for (Element *const &el : elements_)
+	{
+		if (!el->isActive())
+			continue;
+		if (el->getNumberOfDOFs() > 2 * el->getBaseElement()->getNodes().size())
+			unsupported = "the mixed (pressure) formulation";
+		else if (!dynamic_cast<const ElasticSolid *>(el->getMaterial()))
+			unsupported = "materials other than elastic solids";
+	}
+	if (unsupported)
+	{
+		PetscPrintf(PETSC_COMM_WORLD, "The explicit solver does not handle %s.\n", unsupported);
+		MPI_Abort(PETSC_COMM_WORLD, EXIT_FAILURE);
+	}
+
+	assemblyTime_ = 0.0;
+	setReferenceConfiguration(ReferenceConfiguration::INITIAL);
+
+	int rank;
+	MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
+
+	Vec force, mass, externalForce;
+	createSystemVectors(force, mass);
+	VecDuplicate(force, &externalForce);
+
+	const int numberOfLocalDOFs = localDOFs_.size();
+
+	// Local rows: owned dofs followed by the ghosts, in the order of the local form of the ghosted vectors
+	std::vector<int> localIndexes(numberOfLocalDOFs);
+	std::vector<char> constrained(numberOfLocalDOFs, 0);
+	for (int i = 0; i < numberOfLocalDOFs; i++)
+		localIndexes[i] = localDOFs_[i]->getIndex();
+	int numberOfConstrainedDOFs;
+	int *constrainedDOFs;
+	getConstrainedDOFs(numberOfConstrainedDOFs, constrainedDOFs);
+	for (int i = 0; i < numberOfConstrainedDOFs; i++)
+	{
+		const int row = getLocalRow(constrainedDOFs[i]);
+		if (row >= 0)
+			constrained[row] = 1;
+	}
+	delete[] constrainedDOFs;
+
+	// Lumped mass of the local rows, summed over the ranks sharing them
+	Vec massLocal;
+	double *massValues;
+	VecGhostGetLocalForm(mass, &massLocal);
+	VecSet(massLocal, 0.0);
+	VecGetArray(massLocal, &massValues);
+	std::vector<double> elementMass;
+	for (Element *const &el : elements_)
+	{
+		if (el->getRank() != rank || !el->isActive())
+			continue;
+		const std::vector<DegreeOfFreedom *> &dofs = el->getDegreesOfFreedom();
+		elementMass.resize(dofs.size());
+		el->getLumpedMass(elementMass.data());
+		for (unsigned int i = 0; i < dofs.size(); i++)
+			massValues[getLocalRow(dofs[i]->getIndex())] += elementMass[i];
+	}
+	VecRestoreArray(massLocal, &massValues);
+	VecGhostRestoreLocalForm(mass, &massLocal);
+	VecGhostUpdateBegin(mass, ADD_VALUES, SCATTER_REVERSE);
+	VecGhostUpdateEnd(mass, ADD_VALUES, SCATTER_REVERSE);
+
+	// Constant external forces
+	int ndofsForces;
+	std::vector<DegreeOfFreedom *> dofsForces;
+	double *externalForces;
+	getExternalForces(ndofsForces, dofsForces, externalForces);
+	VecZeroEntries(externalForce);
+	if (rank == 0 && ndofsForces > 0)
+	{
+		std::vector<int> indexes(ndofsForces);
+		for (int i = 0; i < ndofsForces; i++)
+			indexes[i] = dofsForces[i]->getIndex();
+		VecSetValues(externalForce, ndofsForces, indexes.data(), externalForces, ADD_VALUES);
+	}
+	VecAssemblyBegin(externalForce);
+	VecAssemblyEnd(externalForce);
+	delete[] externalForces;
+
+	// The state is integrated on contiguous local arrays and written back to the dofs for the force evaluation
+	const int numberOfThreads = std::max(parameters_->getNumberOfThreads(), 1);
+	std::vector<double> position(numberOfLocalDOFs), velocity(numberOfLocalDOFs), acceleration(numberOfLocalDOFs);
+	std::vector<double> inverseMass(numberOfOwnedRows_);
+	{
+		const double *values;
+		VecGetArrayRead(mass, &values);
+		for (int i = 0; i < numberOfOwnedRows_; i++)
+			inverseMass[i] = (constrained[i] || values[i] <= 0.0) ? 0.0 : 1.0 / values[i];
+		VecRestoreArrayRead(mass, &values);
+	}
+	for (int i = 0; i < numberOfLocalDOFs; i++)
+	{
+		position[i] = localDOFs_[i]->getCurrentValue();
+		velocity[i] = constrained[i] ? 0.0 : localDOFs_[i]->getCurrentFirstTimeDerivative();
+	}
+
+	double *current = dofStore_.getCurrentValues();
+	double *currentVel = dofStore_.getCurrentFirstTimeDerivatives();
+	double *currentAccel = dofStore_.getCurrentSecondTimeDerivatives();
+	double *intermediate = dofStore_.getIntermediateValues();
+	double *intermediateAccel = dofStore_.getIntermediateSecondTimeDerivatives();
+	for (int i = 0; i < numberOfLocalDOFs; i++)
+		intermediateAccel[localIndexes[i]] = 0.0;
+
+	// Accelerations of the owned rows from the out-of-balance forces, then brought to the ghosts
+	auto computeAcceleration = [&]()
+	{
+#pragma omp parallel for num_threads(numberOfThreads)
+		for (int i = 0; i < numberOfLocalDOFs; i++)
+			intermediate[localIndexes[i]] = position[i];
+
+		VecCopy(externalForce, force);
+		assembleResidual(force);
+
+		double *values;
+		VecGetArray(force, &values);
+#pragma omp parallel for simd num_threads(numberOfThreads)
+		for (int i = 0; i < numberOfOwnedRows_; i++)
+			values[i] *= inverseMass[i];
+		VecRestoreArray(force, &values);
+
+		Vec forceLocal;
+		const double *accel;
+		VecGhostUpdateBegin(force, INSERT_VALUES, SCATTER_FORWARD);
+		VecGhostUpdateEnd(force, INSERT_VALUES, SCATTER_FORWARD);
+		VecGhostGetLocalForm(force, &forceLocal);
+		VecGetArrayRead(forceLocal, &accel);
+#pragma omp parallel for simd num_threads(numberOfThreads)
+		for (int i = 0; i < numberOfLocalDOFs; i++)
+			acceleration[i] = constrained[i] ? 0.0 : accel[i];
+		VecRestoreArrayRead(forceLocal, &accel);
+		VecGhostRestoreLocalForm(force, &forceLocal);
+	};
+	auto storeState = [&]()
+	{
+#pragma omp parallel for num_threads(numberOfThreads)
+		for (int i = 0; i < numberOfLocalDOFs; i++)
+		{
+			const int k = localIndexes[i];
+			current[k] = position[i];
+			currentVel[k] = velocity[i];
+			currentAccel[k] = acceleration[i];
+		}
+	};
+
+	const double outputDeltat = parameters_->getDeltat();
+	const double outputInterval = outputDeltat * parameters_->getExportFrequency();
+	const double finalTime = parameters_->getDeltat() * parameters_->getNumberOfSteps();
+	double time = 0.0;
+	int numberOfExplicitSteps = 0;
+	int exportStep = 0;
+	double minDeltat = finalTime, maxDeltat = 0.0;
+
+	computeAcceleration();
+	storeState();
+
+	exportGraphicData(0.0);
+	exportToParaview(0);
+
+	while (time < finalTime * (1.0 - 1.0e-12))
+	{
+		// The step is clipped to land on the output times
+		const double nextOutput = std::min(finalTime, outputInterval * (double)(exportStep + 1));
+		const double deltat = std::min(computeStableTimeStep(), nextOutput - time);
+		minDeltat = std::min(minDeltat, deltat);
+		maxDeltat = std::max(maxDeltat, deltat);
+		parameters_->setDeltat(deltat);
+
+		// v(n+1/2) = v(n) + dt/2 a(n), u(n+1) = u(n) + dt v(n+1/2)
+#pragma omp parallel for simd num_threads(numberOfThreads)
+		for (int i = 0; i < numberOfLocalDOFs; i++)
+		{
+			velocity[i] += 0.5 * deltat * acceleration[i];
+			position[i] += deltat * velocity[i];
+		}
+
+		time += deltat;
+		parameters_->setCurrentTime(time);
+		computeAcceleration();
+
+		// v(n+1) = v(n+1/2) + dt/2 a(n+1)
+#pragma omp parallel for simd num_threads(numberOfThreads)
+		for (int i = 0; i < numberOfLocalDOFs; i++)
+			velocity[i] += 0.5 * deltat * acceleration[i];
+		storeState();
+		numberOfExplicitSteps++;
+
+		if (time >= nextOutput * (1.0 - 1.0e-12))
+		{
+			exportStep++;
+			PetscPrintf(PETSC_COMM_WORLD, "Explicit step %d, time = %f, deltat = %E\n", numberOfExplicitSteps, time, deltat);
+			computeCauchyStress();
+			exportGraphicData(time);
+			exportToParaview(exportStep);
+		}
+	}
+
+	flushOutput();
+	VecDestroy(&force);
+	VecDestroy(&mass);
+	VecDestroy(&externalForce);
+	parameters_->setDeltat(outputDeltat);
+
+	auto end_timer = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<double> elapsed = end_timer - start_timer;
+
+	PetscPrintf(PETSC_COMM_WORLD, "Explicit Analysis Done. Elapsed time: %f\n", elapsed.count());
+	PetscPrintf(PETSC_COMM_WORLD, "Explicit steps: %d - deltat from %E to %E\n", numberOfExplicitSteps, minDeltat, maxDeltat);
+	PetscPrintf(PETSC_COMM_WORLD, "Time spent evaluating internal forces: %f\n", assemblyTime_);
 }
 
 void SolidDomain::setInitialVelocityX(std::function<double(double, double, double)> function)
@@ -434,60 +1054,165 @@ double SolidDomain::getInitialPositionNorm() const
 
 void SolidDomain::setPastVariables()
 {
-	for (Node *&node : nodes_)
+	// Streaming loops over the contiguous dof state; only the position dofs carry a time history
+	auto start_timer = std::chrono::high_resolution_clock::now();
+	const int numberOfDOFs = dofStore_.getSize();
+	const DOFType *type = dofStore_.getTypes();
+	const double *current = dofStore_.getCurrentValues();
+	const double *currentVel = dofStore_.getCurrentFirstTimeDerivatives();
+	const double *currentAccel = dofStore_.getCurrentSecondTimeDerivatives();
+	double *past = dofStore_.getPastValues();
+	double *pastVel = dofStore_.getPastFirstTimeDerivatives();
+	double *pastAccel = dofStore_.getPastSecondTimeDerivatives();
+
+#pragma omp simd
+	for (int k = 0; k < numberOfDOFs; k++)
 	{
-		for (int i = 0; i < dimension_; i++)
+		if (type[k] == DOFType::POSITION)
+		{
+			past[k] = current[k];
+			pastVel[k] = currentVel[k];
+			pastAccel[k] = currentAccel[k];
+		}
+	}
+	auto end_timer = std::chrono::high_resolution_clock::now();
+	stateUpdateTime_ += std::chrono::duration_cast<std::chrono::duration<double>>(end_timer - start_timer).count();
+	stateUpdates_++;
+}
+
+void SolidDomain::restorePastVariables()
+{
+	// Rolls a rejected time step back to the state saved by setPastVariables
+	const int numberOfDOFs = dofStore_.getSize();
+	const DOFType *type = dofStore_.getTypes();
+	const double *past = dofStore_.getPastValues();
+	const double *pastVel = dofStore_.getPastFirstTimeDerivatives();
+	const double *pastAccel = dofStore_.getPastSecondTimeDerivatives();
+	double *current = dofStore_.getCurrentValues();
+	double *currentVel = dofStore_.getCurrentFirstTimeDerivatives();
+	double *currentAccel = dofStore_.getCurrentSecondTimeDerivatives();
+
+#pragma omp simd
+	for (int k = 0; k < numberOfDOFs; k++)
+	{
+		if (type[k] == DOFType::POSITION)
+		{
+			current[k] = past[k];
+			currentVel[k] = pastVel[k];
+			currentAccel[k] = pastAccel[k];
+		}
+	}
+}
+
+void SolidDomain::predictPositions(const std::vector<char> &constrained, const std::vector<std::vector<double>> &history,
+								   const std::vector<double> &historyTimes, const double &time)
+{
+	// Initial guess of the free local positions at the new time, once the converged state is in the past variables.
+	// The history holds the local positions of the last converged steps, oldest first.
+	const Predictor predictor = parameters_->getPredictor();
+	if (predictor == Predictor::PREVIOUS_STEP)
+		return;
+
+	const double deltat = parameters_->getDeltat();
+	const int numberOfPoints = history.size();
+	std::vector<double> weights(numberOfPoints, 1.0);
+	if (predictor == Predictor::EXTRAPOLATION)
+		for (int j = 0; j < numberOfPoints; j++)
+			for (int m = 0; m < numberOfPoints; m++)
+				if (m != j)
+					weights[j] *= (time - historyTimes[m]) / (historyTimes[j] - historyTimes[m]);
+
+	const int numberOfLocalDOFs = localDOFs_.size();
+	for (int i = 0; i < numberOfLocalDOFs; i++)
+	{
+		DegreeOfFreedom *dof = localDOFs_[i];
+		if (constrained[i] || dof->getType() != DOFType::POSITION)
+			continue;
+		double value = dof->getPastValue();
+		switch (predictor)
 		{
-			DegreeOfFreedom *dof = node->getDegreeOfFreedom(i);
-			dof->setPastValue(dof->getCurrentValue());
-			dof->setPastFirstTimeDerivative(dof->getCurrentFirstTimeDerivative());
-			dof->setPastSecondTimeDerivative(dof->getCurrentSecondTimeDerivative());
+		case Predictor::CONSTANT_VELOCITY:
+			value += deltat * dof->getPastFirstTimeDerivative();
+			break;
+		case Predictor::CONSTANT_ACCELERATION:
+			value += deltat * dof->getPastFirstTimeDerivative() + 0.5 * deltat * deltat * dof->getPastSecondTimeDerivative();
+			break;
+		case Predictor::EXTRAPOLATION:
+			value = 0.0;
+			for (int j = 0; j < numberOfPoints; j++)
+				value += weights[j] * history[j][i];
+			break;
+		default:
+			break;
 		}
+		dof->setCurrentValue(value);
 	}
 }
 
 void SolidDomain::computeCurrentVariables()
 {
+	auto start_timer = std::chrono::high_resolution_clock::now();
 	double gamma = parameters_->getGamma();
 	double beta = parameters_->getBeta();
 	double deltat = parameters_->getDeltat();
 
-	for (Node *&node : nodes_)
+	const int numberOfDOFs = dofStore_.getSize();
+	const DOFType *type = dofStore_.getTypes();
+	const double *current = dofStore_.getCurrentValues();
+	const double *past = dofStore_.getPastValues();
+	const double *pastVel = dofStore_.getPastFirstTimeDerivatives();
+	const double *pastAccel = dofStore_.getPastSecondTimeDerivatives();
+	double *currentVel = dofStore_.getCurrentFirstTimeDerivatives();
+	double *currentAccel = dofStore_.getCurrentSecondTimeDerivatives();
+
+#pragma omp simd
+	for (int k = 0; k < numberOfDOFs; k++)
 	{
-		for (int i = 0; i < dimension_; i++)
+		if (type[k] == DOFType::POSITION)
 		{
-			double vel, accel;
-			DegreeOfFreedom *dof = node->getDegreeOfFreedom(i);
-			accel = (dof->getCurrentValue() - dof->getPastValue()) / (beta * deltat * deltat) -
-					dof->getPastFirstTimeDerivative() / (beta * deltat) - dof->getPastSecondTimeDerivative() * (0.5 / beta - 1.0);
-			dof->setCurrentSecondTimeDerivative(accel);
-			vel = gamma * deltat * dof->getCurrentSecondTimeDerivative() + dof->getPastFirstTimeDerivative() +
-				  deltat * (1.0 - gamma) * dof->getPastSecondTimeDerivative();
-			dof->setCurrentFirstTimeDerivative(vel);
+			double accel = (current[k] - past[k]) / (beta * deltat * deltat) -
+						   pastVel[k] / (beta * deltat) - pastAccel[k] * (0.5 / beta - 1.0);
+			currentAccel[k] = accel;
+			currentVel[k] = gamma * deltat * accel + pastVel[k] + deltat * (1.0 - gamma) * pastAccel[k];
 		}
 	}
+	auto end_timer = std::chrono::high_resolution_clock::now();
+	stateUpdateTime_ += std::chrono::duration_cast<std::chrono::duration<double>>(end_timer - start_timer).count();
+	stateUpdates_++;
 }
 
 void SolidDomain::computeIntermediateVariables()
 {
+	auto start_timer = std::chrono::high_resolution_clock::now();
 	// Computing alpha-generalized and Newmark parameters
 	double alphaM = parameters_->getAlphaM();
 	double alphaF = parameters_->getAlphaF();
 
-	for (Node *node : nodes_)
+	const int numberOfDOFs = dofStore_.getSize();
+	const DOFType *type = dofStore_.getTypes();
+	const double *current = dofStore_.getCurrentValues();
+	const double *currentVel = dofStore_.getCurrentFirstTimeDerivatives();
+	const double *currentAccel = dofStore_.getCurrentSecondTimeDerivatives();
+	const double *past = dofStore_.getPastValues();
+	const double *pastVel = dofStore_.getPastFirstTimeDerivatives();
+	const double *pastAccel = dofStore_.getPastSecondTimeDerivatives();
+	double *intermediate = dofStore_.getIntermediateValues();
+	double *intermediateVel = dofStore_.getIntermediateFirstTimeDerivatives();
+	double *intermediateAccel = dofStore_.getIntermediateSecondTimeDerivatives();
+
+#pragma omp simd
+	for (int k = 0; k < numberOfDOFs; k++)
 	{
-		for (int i = 0; i < dimension_; i++)
+		if (type[k] == DOFType::POSITION)
 		{
-			double coordinate, vel, accel;
-			DegreeOfFreedom *dof = node->getDegreeOfFreedom(i);
-			coordinate = dof->getPastValue() + alphaF * (dof->getCurrentValue() - dof->getPastValue());
-			dof->setIntermediateValue(coordinate);
-			vel = dof->getPastFirstTimeDerivative() + alphaF * (dof->getCurrentFirstTimeDerivative() - dof->getPastFirstTimeDerivative());
-			dof->setIntermediateFirstTimeDerivative(vel);
-			accel = dof->getPastSecondTimeDerivative() + alphaM * (dof->getCurrentSecondTimeDerivative() - dof->getPastSecondTimeDerivative());
-			dof->setIntermediateSecondTimeDerivative(accel);
+			intermediate[k] = past[k] + alphaF * (current[k] - past[k]);
+			intermediateVel[k] = pastVel[k] + alphaF * (currentVel[k] - pastVel[k]);
+			intermediateAccel[k] = pastAccel[k] + alphaM * (currentAccel[k] - pastAccel[k]);
 		}
 	}
+	auto end_timer = std::chrono::high_resolution_clock::now();
+	stateUpdateTime_ += std::chrono::duration_cast<std::chrono::duration<double>>(end_timer - start_timer).count();
+	stateUpdates_++;
 }
 
 void SolidDomain::getConstrainedDOFs(int &ndofs, int *&constrainedDOFs)
@@ -541,69 +1266,505 @@ double SolidDomain::getSurfaceForcesPotentialEnergy()
 
 void SolidDomain::assembleTransientLinearSystem(Mat &mat, Vec &vec)
 {
-	auto start_timer = std::chrono::high_resolution_clock::now();
-
-	int rank;
-	MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
+	assembleLinearSystem(mat, vec);
+}
 
+void SolidDomain::evaluateLocalElements(const ElementConsumer &consume, const bool &residualOnly)
+{
+	// Element buffers are allocated once and reused by every element. Residual-only passes get no hessian buffer,
+	// and the elements skip the tangent altogether.
+	unsigned int maxElementDOFs = 0;
 	for (Element *const &el : elements_)
+		maxElementDOFs = std::max(maxElementDOFs, el->getNumberOfDOFs());
+
+	// A batch is either a single element or up to PlaneElement::batchWidth compatible plane elements, which are
+	// evaluated together by the SIMD element kernel
+	auto evaluateBatch = [&](const int &thread, const std::vector<int> &color, const int &begin, const int &end,
+							 std::vector<int> &indexes, std::vector<double> &rhs, std::vector<double> &hessian)
 	{
-		if (el->getRank() == rank && el->isActive())
+		const PlaneElement *batch[PlaneElement::batchWidth];
+		int positions[PlaneElement::batchWidth];
+		int count = 0;
+		for (int k = begin; k < end; k++)
 		{
-			int ndofsPosition, ndofsPressure;
-			int *indexes;
-			double *rhsValues, *hessianValues;
-			el->elementContributions(ndofsPosition, ndofsPressure, indexes, rhsValues, hessianValues);
-			int ndofs = ndofsPosition + ndofsPressure;
-			// dispersing element rhs contribution into global rhs vector
-			VecSetValues(vec, ndofs, indexes, rhsValues, ADD_VALUES);
+			if (!elements_[color[k]]->isActive())
+				continue;
+			positions[count] = color[k];
+			batch[count++] = static_cast<const PlaneElement *>(elements_[color[k]]);
+		}
+		if (count == 0)
+			return;
 
-			// dispersing element matrices contribution into global tangent matrix
-			for (int i = 0; i < ndofsPosition; i++)
-			{
-				for (int j = 0; j < ndofsPosition; j++)
-				{
-					double value = hessianValues[ndofs * i + j]; // value = 0.0;
-					MatSetValues(mat, 1, &indexes[i], 1, &indexes[j], &value, ADD_VALUES);
-				}
-				for (int j = 0; j < ndofsPressure; j++)
-				{
-					double value = hessianValues[ndofsPosition + ndofs * i + j]; // value = 0.0;
-					MatSetValues(mat, 1, &indexes[i], 1, &indexes[ndofsPosition + j], &value, ADD_VALUES);
-				}
-			}
+		double *hessianValues = residualOnly ? nullptr : hessian.data();
+		int ndofsPosition, ndofsPressure;
+		if (count > 1)
+			PlaneElement::elementContributionsBatch(batch, count, ndofsPosition, ndofsPressure, indexes.data(), rhs.data(), hessianValues);
+		else
+			elements_[positions[0]]->elementContributions(ndofsPosition, ndofsPressure, indexes.data(), rhs.data(), hessianValues);
+
+		const int ndofs = ndofsPosition + ndofsPressure;
+		if (ndofs == 0)
+			return;
+		for (int l = 0; l < count; l++)
+			consume(thread, positions[l], ndofs, indexes.data() + l * ndofs, rhs.data() + l * ndofs,
+					residualOnly ? nullptr : hessianValues + l * ndofs * ndofs);
+	};
+
+	const unsigned int hessianSize = residualOnly ? 0 : PlaneElement::batchWidth * maxElementDOFs * maxElementDOFs;
+	const int numberOfThreads = parameters_->getNumberOfThreads();
+	if (numberOfThreads > 1)
+	{
+		// Elements of one color share no nodes, so the threads touch disjoint rows without locks
+		for (unsigned int c = 0; c < elementColors_.size(); c++)
+		{
+			const std::vector<int> &color = elementColors_[c];
+			const std::vector<int> &batches = colorBatches_[c];
+			const int numberOfBatches = batches.size() - 1;
 
-			for (int i = 0; i < ndofsPressure; i++)
+#pragma omp parallel num_threads(numberOfThreads)
 			{
-				for (int j = 0; j < ndofsPosition; j++)
-				{
-					double value = hessianValues[ndofs * (ndofsPosition + i) + j]; // value = 0.0;
-					MatSetValues(mat, 1, &indexes[ndofsPosition + i], 1, &indexes[j], &value, ADD_VALUES);
-				}
-				for (int j = 0; j < ndofsPressure; j++)
-				{
-					double value = hessianValues[ndofs * (ndofsPosition + i) + ndofsPosition + j]; // value = 0.0;
-					MatSetValues(mat, 1, &indexes[ndofsPosition + i], 1, &indexes[ndofsPosition + j], &value, ADD_VALUES);
-				}
+				int thread = 0;
+#ifdef _OPENMP
+				thread = omp_get_thread_num();
+#endif
+				std::vector<int> indexes(PlaneElement::batchWidth * maxElementDOFs);
+				std::vector<double> rhs(PlaneElement::batchWidth * maxElementDOFs);
+				std::vector<double> hessian(hessianSize);
+
+#pragma omp for schedule(dynamic, 4)
+				for (int b = 0; b < numberOfBatches; b++)
+					evaluateBatch(thread, color, batches[b], batches[b + 1], indexes, rhs, hessian);
 			}
-			delete[] indexes;
-			delete[] rhsValues;
-			delete[] hessianValues;
 		}
 	}
+	else
+	{
+		std::vector<int> indexes(PlaneElement::batchWidth * maxElementDOFs);
+		std::vector<double> rhs(PlaneElement::batchWidth * maxElementDOFs);
+		std::vector<double> hessian(hessianSize);
 
-	// Assemble matrices and vectors
-	MatAssemblyBegin(mat, MAT_FINAL_ASSEMBLY);
-	MatAssemblyEnd(mat, MAT_FINAL_ASSEMBLY);
-	VecAssemblyBegin(vec);
-	VecAssemblyEnd(vec);
+		// the colors hold every local element
+		for (unsigned int c = 0; c < elementColors_.size(); c++)
+		{
+			const std::vector<int> &batches = colorBatches_[c];
+			const int numberOfBatches = batches.size() - 1;
+			for (int b = 0; b < numberOfBatches; b++)
+				evaluateBatch(0, elementColors_[c], batches[b], batches[b + 1], indexes, rhs, hessian);
+		}
+	}
+}
 
-	auto end_timer = std::chrono::high_resolution_clock::now();
+void SolidDomain::assembleLinearSystem(Mat &mat, Vec &vec)
+{
+	auto start_timer = std::chrono::high_resolution_clock::now();
+
+	int rank;
+	MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
+
+	// The element matrices are scattered straight into the CSR value array through the element slot maps:
+	// PETSc's own array for a sequential AIJ matrix, otherwise a local copy that is inserted row by row afterwards.
+	PetscBool isSeqAIJ;
+	PetscObjectTypeCompare((PetscObject)mat, MATSEQAIJ, &isSeqAIJ);
+	double *tangentValues;
+	if (isSeqAIJ)
+		MatSeqAIJGetArray(mat, &tangentValues);
+	else
+		tangentValues = tangentValues_.data();
+	std::fill(tangentValues, tangentValues + columnIndexes_.size(), 0.0);
+
+	double *rhsValues;
+	VecGetArray(vec, &rhsValues);
+
+	// Contributions to rows owned by other ranks are staged per thread and sent through PETSc after the local scatter
+	const int numberOfThreads = std::max(parameters_->getNumberOfThreads(), 1);
+	std::vector<std::vector<int>> threadDOFs(numberOfThreads), threadIndexes(numberOfThreads);
+	std::vector<std::vector<double>> threadRhs(numberOfThreads), threadHessian(numberOfThreads);
+
+	auto scatter = [&](const int &thread, const int &element, const int &ndofs, const int *indexes,
+					   const double *elementRhs, const double *elementHessian)
+	{
+		if (scatterElementContributions(element, ndofs, indexes, elementRhs, elementHessian, tangentValues, rhsValues))
+			return;
+		threadDOFs[thread].push_back(ndofs);
+		threadIndexes[thread].insert(threadIndexes[thread].end(), indexes, indexes + ndofs);
+		threadRhs[thread].insert(threadRhs[thread].end(), elementRhs, elementRhs + ndofs);
+		threadHessian[thread].insert(threadHessian[thread].end(), elementHessian, elementHessian + ndofs * ndofs);
+	};
+	evaluateLocalElements(scatter);
+
+	std::vector<int> offProcessDOFs, offProcessIndexes;
+	std::vector<double> offProcessRhs, offProcessHessian;
+	for (int thread = 0; thread < numberOfThreads; thread++)
+	{
+		offProcessDOFs.insert(offProcessDOFs.end(), threadDOFs[thread].begin(), threadDOFs[thread].end());
+		offProcessIndexes.insert(offProcessIndexes.end(), threadIndexes[thread].begin(), threadIndexes[thread].end());
+		offProcessRhs.insert(offProcessRhs.end(), threadRhs[thread].begin(), threadRhs[thread].end());
+		offProcessHessian.insert(offProcessHessian.end(), threadHessian[thread].begin(), threadHessian[thread].end());
+	}
+
+	VecRestoreArray(vec, &rhsValues);
+
+	if (isSeqAIJ)
+	{
+		MatSeqAIJRestoreArray(mat, &tangentValues);
+	}
+	else
+	{
+		// Whole owned rows are inserted, the columns being already sorted
+		for (int i = 0; i < numberOfOwnedRows_; i++)
+		{
+			int row = firstOwnedRow_ + i;
+			int ncols = rowPointer_[i + 1] - rowPointer_[i];
+			MatSetValues(mat, 1, &row, ncols, &columnIndexes_[rowPointer_[i]], &tangentValues_[rowPointer_[i]], INSERT_VALUES);
+		}
+		MatAssemblyBegin(mat, MAT_FLUSH_ASSEMBLY);
+		MatAssemblyEnd(mat, MAT_FLUSH_ASSEMBLY);
+	}
+
+	// dispersing the contributions to rows owned by other ranks
+	const int lastOwnedRow = firstOwnedRow_ + numberOfOwnedRows_;
+	int indexOffset = 0, hessianOffset = 0;
+	for (const int &ndofs : offProcessDOFs)
+	{
+		int *indexes = &offProcessIndexes[indexOffset];
+		for (int i = 0; i < ndofs; i++)
+		{
+			if (indexes[i] >= firstOwnedRow_ && indexes[i] < lastOwnedRow)
+				continue;
+			VecSetValues(vec, 1, &indexes[i], &offProcessRhs[indexOffset + i], ADD_VALUES);
+			MatSetValues(mat, 1, &indexes[i], ndofs, indexes, &offProcessHessian[hessianOffset + ndofs * i], ADD_VALUES);
+		}
+		indexOffset += ndofs;
+		hessianOffset += ndofs * ndofs;
+	}
+
+	// Assemble matrices and vectors
+	MatAssemblyBegin(mat, MAT_FINAL_ASSEMBLY);
+	MatAssemblyEnd(mat, MAT_FINAL_ASSEMBLY);
+	VecAssemblyBegin(vec);
+	VecAssemblyEnd(vec);
+
+	auto end_timer = std::chrono::high_resolution_clock::now();
 	std::chrono::duration<double> elapsed = end_timer - start_timer;
+	assemblyTime_ += elapsed.count();
 
 	// PetscPrintf(PETSC_COMM_WORLD, "Assemble Linear System. Elapsed time: %f\n", elapsed.count());
 }
 
+bool SolidDomain::scatterElementContributions(const int &element, const int &ndofs, const int *indexes,
+											  const double *rhsValues, const double *hessianValues,
+											  double *tangentValues, double *rhs) const
+{
+	// Adds the owned rows of an element contribution through its slot map and reports whether any row is owned elsewhere
+	const int *slots = &elementSlots_[elementSlotOffsets_[element]];
+	bool allRowsOwned = true;
+	for (int i = 0; i < ndofs; i++)
+	{
+		if (slots[ndofs * i] < 0)
+		{
+			allRowsOwned = false;
+			continue;
+		}
+		rhs[indexes[i] - firstOwnedRow_] += rhsValues[i];
+		for (int j = 0; j < ndofs; j++)
+			tangentValues[slots[ndofs * i + j]] += hessianValues[ndofs * i + j];
+	}
+	return allRowsOwned;
+}
+
+void SolidDomain::assembleResidual(Vec &vec, Mat preconditioner)
+{
+	// Right hand side for the matrix-free tangent, and in the same element pass its assembled preconditioner
+	auto start_timer = std::chrono::high_resolution_clock::now();
+
+	double *rhsValues;
+	VecGetArray(vec, &rhsValues);
+
+	const int numberOfThreads = std::max(parameters_->getNumberOfThreads(), 1);
+	std::vector<std::vector<int>> threadIndexes(numberOfThreads);
+	std::vector<std::vector<double>> threadRhs(numberOfThreads);
+
+	// The kept blocks of the element matrices are staged per thread as (size, indexes, values)
+	std::vector<std::vector<int>> threadBlockSizes(numberOfThreads), threadBlockIndexes(numberOfThreads);
+	std::vector<std::vector<double>> threadBlockValues(numberOfThreads);
+	std::vector<std::vector<int>> threadPositions(numberOfThreads);
+	auto stageBlock = [&](const int &thread, const int &ndofs, const int *indexes, const double *elementHessian,
+						  const std::vector<int> &positions)
+	{
+		const int size = positions.size();
+		threadBlockSizes[thread].push_back(size);
+		for (const int &i : positions)
+		{
+			threadBlockIndexes[thread].push_back(indexes[i]);
+			for (const int &j : positions)
+				threadBlockValues[thread].push_back(elementHessian[ndofs * i + j]);
+		}
+	};
+
+	auto scatter = [&](const int &thread, const int &element, const int &ndofs, const int *indexes,
+					   const double *elementRhs, const double *elementHessian)
+	{
+		for (int i = 0; i < ndofs; i++)
+		{
+			const int row = indexes[i] - firstOwnedRow_;
+			if (row >= 0 && row < numberOfOwnedRows_)
+				rhsValues[row] += elementRhs[i];
+			else
+			{
+				threadIndexes[thread].push_back(indexes[i]);
+				threadRhs[thread].push_back(elementRhs[i]);
+			}
+		}
+		if (!preconditioner)
+			return;
+
+		// Position dofs come node by node, followed by one pressure per node in the mixed formulation
+		const ParametricElement *parametric = elements_[element]->getParametricElement();
+		const int numberOfNodes = parametric->getNumberOfNodes();
+		const int numberOfVertices = parametric->getNumberOfEdges();
+		auto node = [&](const int &i) { return (i < 2 * numberOfNodes) ? i / 2 : i - 2 * numberOfNodes; };
+
+		std::vector<int> &positions = threadPositions[thread];
+		positions.clear();
+		for (int i = 0; i < ndofs; i++)
+			if (node(i) < numberOfVertices)
+				positions.push_back(i);
+		stageBlock(thread, ndofs, indexes, elementHessian, positions);
+		for (int a = numberOfVertices; a < numberOfNodes; a++)
+		{
+			positions.clear();
+			for (int i = 0; i < ndofs; i++)
+				if (node(i) == a)
+					positions.push_back(i);
+			stageBlock(thread, ndofs, indexes, elementHessian, positions);
+		}
+	};
+	evaluateLocalElements(scatter, !preconditioner);
+
+	VecRestoreArray(vec, &rhsValues);
+	for (int thread = 0; thread < numberOfThreads; thread++)
+		VecSetValues(vec, threadIndexes[thread].size(), threadIndexes[thread].data(), threadRhs[thread].data(), ADD_VALUES);
+	VecAssemblyBegin(vec);
+	VecAssemblyEnd(vec);
+
+	if (preconditioner)
+	{
+		MatZeroEntries(preconditioner);
+		for (int thread = 0; thread < numberOfThreads; thread++)
+		{
+			int indexOffset = 0, valueOffset = 0;
+			for (const int &size : threadBlockSizes[thread])
+			{
+				const int *indexes = &threadBlockIndexes[thread][indexOffset];
+				MatSetValues(preconditioner, size, indexes, size, indexes, &threadBlockValues[thread][valueOffset], ADD_VALUES);
+				indexOffset += size;
+				valueOffset += size * size;
+			}
+		}
+		MatAssemblyBegin(preconditioner, MAT_FINAL_ASSEMBLY);
+		MatAssemblyEnd(preconditioner, MAT_FINAL_ASSEMBLY);
+	}
+
+	auto end_timer = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<double> elapsed = end_timer - start_timer;
+	assemblyTime_ += elapsed.count();
+}
+
+int SolidDomain::getLocalRow(const int &index) const
+{
+	// Position of a dof in the local form of the ghosted vectors (-1 if it is not local)
+	if (index >= firstOwnedRow_ && index < firstOwnedRow_ + numberOfOwnedRows_)
+		return index - firstOwnedRow_;
+	auto ghost = std::lower_bound(ghostIndexes_.begin(), ghostIndexes_.end(), index);
+	if (ghost == ghostIndexes_.end() || *ghost != index)
+		return -1;
+	return numberOfOwnedRows_ + (ghost - ghostIndexes_.begin());
+}
+
+void SolidDomain::createMatrixFreeTangent(Mat &mat, Mat &preconditioner, const int &numberOfConstrainedDOFs, const int *constrainedDOFs)
+{
+	// The tangent is never stored: its products are computed element by element from the current state, and the
+	// Dirichlet rows and columns are replaced by the identity as MatZeroRowsColumns does for the assembled matrix
+	if (systemPatternOutdated_ || (int)rowPointer_.size() != numberOfOwnedRows_ + 1)
+		buildSystemPattern();
+
+	int N = numberOfBlockedDOFs_;
+	int n = numberOfOwnedRows_;
+
+	MatCreateShell(PETSC_COMM_WORLD, n, n, N, N, this, &mat);
+	MatShellSetOperation(mat, MATOP_MULT, (void (*)(void))matrixFreeMult);
+	MatShellSetOperation(mat, MATOP_GET_DIAGONAL, (void (*)(void))matrixFreeDiagonal);
+
+	VecCreateGhost(PETSC_COMM_WORLD, n, N, ghostIndexes_.size(), ghostIndexes_.data(), &matrixFreeInput_);
+	VecDuplicate(matrixFreeInput_, &matrixFreeOutput_);
+
+	// The preconditioner is assembled from the vertex part of the element matrices: the couplings between the
+	// element vertices (the tangent of the underlying linear element) and the diagonal block of every other node.
+	// For T3 and Q4 meshes it is the whole tangent, for T10 or Q16 only a small fraction of it.
+	std::vector<char> vertexNodes(nodes_.size(), 0);
+	for (Element *const &el : elements_)
+	{
+		const std::vector<Node *> &elementNodes = el->getBaseElement()->getNodes();
+		const int numberOfVertices = el->getParametricElement()->getNumberOfEdges();
+		for (int a = 0; a < numberOfVertices; a++)
+			vertexNodes[elementNodes[a]->getIndex()] = 1;
+	}
+
+	const int lastRow = firstOwnedRow_ + n;
+	std::vector<int> diagonalNonzeros(n, 0), offDiagonalNonzeros(n, 0);
+	for (Node *const &node : nodes_)
+	{
+		const std::vector<DegreeOfFreedom *> &dofs = node->getDegreesOfFreedom();
+		if (dofs.empty() || dofs.back()->getIndex() < firstOwnedRow_ || dofs.front()->getIndex() >= lastRow)
+			continue;
+		const bool vertex = vertexNodes[node->getIndex()];
+		int diagonal = 0, offDiagonal = 0;
+		for (Node *const &neighborNode : node->getNeighborNodes())
+		{
+			if (vertex ? !vertexNodes[neighborNode->getIndex()] : neighborNode != node)
+				continue;
+			for (DegreeOfFreedom *const &dof : neighborNode->getDegreesOfFreedom())
+			{
+				if (dof->getIndex() >= firstOwnedRow_ && dof->getIndex() < lastRow)
+					diagonal++;
+				else
+					offDiagonal++;
+			}
+		}
+		for (DegreeOfFreedom *const &dof : dofs)
+		{
+			const int row = dof->getIndex() - firstOwnedRow_;
+			if (row < 0 || row >= n)
+				continue;
+			diagonalNonzeros[row] = diagonal;
+			offDiagonalNonzeros[row] = offDiagonal;
+		}
+	}
+	MatCreateAIJ(PETSC_COMM_WORLD, n, n, N, N, 0, diagonalNonzeros.data(), 0, offDiagonalNonzeros.data(), &preconditioner);
+	MatSetOption(preconditioner, MAT_NEW_NONZERO_ALLOCATION_ERR, PETSC_TRUE);
+
+	double nonzeros[2] = {0.0, (double)columnIndexes_.size()}; // preconditioner and assembled tangent
+	for (int i = 0; i < n; i++)
+		nonzeros[0] += diagonalNonzeros[i] + offDiagonalNonzeros[i];
+	MPI_Allreduce(MPI_IN_PLACE, nonzeros, 2, MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);
+	PetscPrintf(PETSC_COMM_WORLD, "Matrix-free tangent: the assembled preconditioner has %.0f nonzeros, %.1f%% of the %.0f of the tangent\n",
+				nonzeros[0], 100.0 * nonzeros[0] / std::max(nonzeros[1], 1.0), nonzeros[1]);
+
+	// Only the row distribution and the ghosts are needed, the CSR arrays are released
+	std::vector<int>().swap(rowPointer_);
+	std::vector<int>().swap(columnIndexes_);
+	std::vector<double>().swap(tangentValues_);
+	std::vector<int>().swap(elementSlots_);
+
+	matrixFreeConstrained_.assign(n + ghostIndexes_.size(), 0);
+	for (int i = 0; i < numberOfConstrainedDOFs; i++)
+	{
+		const int row = getLocalRow(constrainedDOFs[i]);
+		if (row >= 0)
+			matrixFreeConstrained_[row] = 1;
+	}
+	matrixFreeProducts_ = 0;
+	matrixFreeTime_ = 0.0;
+}
+
+void SolidDomain::applyMatrixFreeTangent(Vec &x, Vec &y, const bool &diagonalOnly)
+{
+	auto start_timer = std::chrono::high_resolution_clock::now();
+
+	Vec inputLocal, outputLocal;
+	double *input = nullptr;
+	if (!diagonalOnly)
+	{
+		VecCopy(x, matrixFreeInput_);
+		VecGhostUpdateBegin(matrixFreeInput_, INSERT_VALUES, SCATTER_FORWARD);
+		VecGhostUpdateEnd(matrixFreeInput_, INSERT_VALUES, SCATTER_FORWARD);
+		VecGhostGetLocalForm(matrixFreeInput_, &inputLocal);
+		VecGetArray(inputLocal, &input);
+		const int numberOfLocalRows = matrixFreeConstrained_.size();
+		for (int i = 0; i < numberOfLocalRows; i++)
+			if (matrixFreeConstrained_[i])
+				input[i] = 0.0;
+	}
+
+	double *output;
+	VecGhostGetLocalForm(matrixFreeOutput_, &outputLocal);
+	VecSet(outputLocal, 0.0);
+	VecGetArray(outputLocal, &output);
+
+	// Elements of one color share no rows, so the threads accumulate into the output without locks
+	unsigned int maxElementDOFs = 0;
+	for (Element *const &el : elements_)
+		maxElementDOFs = std::max(maxElementDOFs, el->getNumberOfDOFs());
+	std::vector<std::vector<int>> threadRows(std::max(parameters_->getNumberOfThreads(), 1), std::vector<int>(maxElementDOFs));
+	auto multiply = [&](const int &thread, const int &element, const int &ndofs, const int *indexes,
+						const double *elementRhs, const double *elementHessian)
+	{
+		int *rows = threadRows[thread].data();
+		for (int i = 0; i < ndofs; i++)
+			rows[i] = getLocalRow(indexes[i]);
+
+		for (int i = 0; i < ndofs; i++)
+		{
+			if (diagonalOnly)
+			{
+				output[rows[i]] += elementHessian[ndofs * i + i];
+				continue;
+			}
+			double sum = 0.0;
+			for (int j = 0; j < ndofs; j++)
+				sum += elementHessian[ndofs * i + j] * input[rows[j]];
+			output[rows[i]] += sum;
+		}
+	};
+	evaluateLocalElements(multiply);
+
+	VecRestoreArray(outputLocal, &output);
+	VecGhostRestoreLocalForm(matrixFreeOutput_, &outputLocal);
+	if (!diagonalOnly)
+	{
+		VecRestoreArray(inputLocal, &input);
+		VecGhostRestoreLocalForm(matrixFreeInput_, &inputLocal);
+	}
+
+	// Contributions to ghost rows are added to their owners
+	VecGhostUpdateBegin(matrixFreeOutput_, ADD_VALUES, SCATTER_REVERSE);
+	VecGhostUpdateEnd(matrixFreeOutput_, ADD_VALUES, SCATTER_REVERSE);
+	VecCopy(matrixFreeOutput_, y);
+
+	double *result;
+	const double *values = nullptr;
+	VecGetArray(y, &result);
+	if (!diagonalOnly)
+		VecGetArrayRead(x, &values);
+	for (int i = 0; i < numberOfOwnedRows_; i++)
+		if (matrixFreeConstrained_[i])
+			result[i] = diagonalOnly ? 1.0 : values[i];
+	if (!diagonalOnly)
+		VecRestoreArrayRead(x, &values);
+	VecRestoreArray(y, &result);
+
+	auto end_timer = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<double> elapsed = end_timer - start_timer;
+	matrixFreeTime_ += elapsed.count();
+	matrixFreeProducts_++;
+}
+
+PetscErrorCode SolidDomain::matrixFreeMult(Mat mat, Vec x, Vec y)
+{
+	SolidDomain *domain;
+	MatShellGetContext(mat, &domain);
+	domain->applyMatrixFreeTangent(x, y, false);
+	return 0;
+}
+
+PetscErrorCode SolidDomain::matrixFreeDiagonal(Mat mat, Vec diagonal)
+{
+	SolidDomain *domain;
+	MatShellGetContext(mat, &domain);
+	domain->applyMatrixFreeTangent(diagonal, diagonal, true);
+	return 0;
+}
+
 void SolidDomain::applyNeummanConditions(Vec &vec, Mat &mat, int &ndofs, const std::vector<DegreeOfFreedom *> &dofsForces, double *&externalForces, const double &loadFactor)
 {
 	int rank;
@@ -697,11 +1858,237 @@ void SolidDomain::applyNeummanConditions(Vec &vec, Mat &mat, int &ndofs, const s
 	}
 }
 
-void SolidDomain::solveLinearSystem(KSP &ksp, Mat &mat, Vec &rhs, Vec &solution)
+void SolidDomain::configureLinearSolver(KSP &ksp, const SolverProfile &defaultProfile, const bool &matrixFree)
+{
+	// Every profile has its own options prefix, so e.g. -gamg_ksp_rtol or -mumps_mat_mumps_icntl_14 still apply
+	int size;
+	MPI_Comm_size(PETSC_COMM_WORLD, &size);
+
+	SolverProfile profile = parameters_->getSolverProfile();
+	if (profile == SolverProfile::DEFAULT)
+		profile = defaultProfile;
+	if (profile == SolverProfile::DIRECT_SERIAL && size > 1)
+	{
+		PetscPrintf(PETSC_COMM_WORLD, "The serial direct solver cannot run on %d ranks, using MUMPS instead\n", size);
+		profile = SolverProfile::DIRECT_MUMPS;
+	}
+
+	if (matrixFree && (profile == SolverProfile::DIRECT_SERIAL || profile == SolverProfile::DIRECT_MUMPS))
+	{
+		// The preconditioner only approximates the matrix-free tangent, so a Krylov method has to run on top of it
+		PetscPrintf(PETSC_COMM_WORLD, "The matrix-free tangent needs an iterative solver, using FGMRES with block Jacobi instead\n");
+		profile = SolverProfile::FGMRES_BJACOBI;
+	}
+	if (profile == SolverProfile::FIELDSPLIT_SCHUR && pressureIndexes_.empty())
+	{
+		PetscPrintf(PETSC_COMM_WORLD, "The fieldsplit solver needs pressure degrees of freedom, using the default solver instead\n");
+		profile = defaultProfile;
+	}
+	linearSolverProfile_ = profile;
+
+	PC pc;
+	KSPGetPC(ksp, &pc);
+	switch (profile)
+	{
+	case SolverProfile::FGMRES_BJACOBI:
+		KSPSetOptionsPrefix(ksp, "fgmres_bjacobi_");
+		KSPSetType(ksp, KSPFGMRES);
+		KSPSetTolerances(ksp, 1.0e-8, PETSC_DEFAULT, PETSC_DEFAULT, 100);
+		KSPGMRESSetRestart(ksp, 100);
+		PCSetType(pc, PCBJACOBI);
+		break;
+	case SolverProfile::FGMRES_JACOBI:
+		KSPSetOptionsPrefix(ksp, "fgmres_jacobi_");
+		KSPSetType(ksp, KSPFGMRES);
+		KSPSetTolerances(ksp, 1.0e-8, PETSC_DEFAULT, PETSC_DEFAULT, 1000);
+		KSPGMRESSetRestart(ksp, 100);
+		PCSetType(pc, PCJACOBI);
+		break;
+	case SolverProfile::DIRECT_SERIAL:
+		KSPSetOptionsPrefix(ksp, "direct_");
+		KSPSetType(ksp, KSPPREONLY);
+		PCSetType(pc, PCLU);
+		PCFactorSetMatSolverType(pc, MATSOLVERPETSC);
+		break;
+	case SolverProfile::DIRECT_MUMPS:
+		KSPSetOptionsPrefix(ksp, "mumps_");
+		KSPSetType(ksp, KSPPREONLY);
+		PCSetType(pc, PCLU);
+		PCFactorSetMatSolverType(pc, MATSOLVERMUMPS);
+		break;
+	case SolverProfile::GAMG_CG:
+		KSPSetOptionsPrefix(ksp, "gamg_");
+		KSPSetType(ksp, KSPCG);
+		KSPSetTolerances(ksp, 1.0e-8, PETSC_DEFAULT, PETSC_DEFAULT, 1000);
+		PCSetType(pc, PCGAMG);
+		break;
+	case SolverProfile::FIELDSPLIT_SCHUR:
+	{
+		KSPSetOptionsPrefix(ksp, "schur_");
+		KSPSetType(ksp, KSPFGMRES);
+		KSPSetTolerances(ksp, 1.0e-8, PETSC_DEFAULT, PETSC_DEFAULT, 1000);
+		KSPGMRESSetRestart(ksp, 100);
+		PCSetType(pc, PCFIELDSPLIT);
+		PCFieldSplitSetType(pc, PC_COMPOSITE_SCHUR);
+		PCFieldSplitSetSchurFactType(pc, PC_FIELDSPLIT_SCHUR_FACT_FULL);
+		// The Schur complement is preconditioned by A11 - A10 diag(A00)^-1 A01, i.e. the PSPG block plus a
+		// lumped approximation of B M^-1 B^T, which behaves like a scaled pressure Laplacian
+		PCFieldSplitSetSchurPre(pc, PC_FIELDSPLIT_SCHUR_PRE_SELFP, nullptr);
+
+		// Owned rows of each split
+		const int firstRow = firstOwnedRow_;
+		const int lastRow = firstOwnedRow_ + numberOfOwnedRows_;
+		auto positionBegin = std::lower_bound(positionIndexes_.begin(), positionIndexes_.end(), firstRow);
+		auto positionEnd = std::lower_bound(positionBegin, positionIndexes_.end(), lastRow);
+		auto pressureBegin = std::lower_bound(pressureIndexes_.begin(), pressureIndexes_.end(), firstRow);
+		auto pressureEnd = std::lower_bound(pressureBegin, pressureIndexes_.end(), lastRow);
+
+		IS position, pressure;
+		ISCreateGeneral(PETSC_COMM_WORLD, positionEnd - positionBegin, positionIndexes_.data() + (positionBegin - positionIndexes_.begin()), PETSC_COPY_VALUES, &position);
+		ISCreateGeneral(PETSC_COMM_WORLD, pressureEnd - pressureBegin, pressureIndexes_.data() + (pressureBegin - pressureIndexes_.begin()), PETSC_COPY_VALUES, &pressure);
+		PCFieldSplitSetIS(pc, "position", position);
+		PCFieldSplitSetIS(pc, "pressure", pressure);
+		ISDestroy(&position);
+		ISDestroy(&pressure);
+
+		// One algebraic multigrid cycle for each block unless other solvers are given in the command line
+		const std::pair<const char *, const char *> blockDefaults[] = {{"-schur_fieldsplit_position_ksp_type", "preonly"},
+																	   {"-schur_fieldsplit_position_pc_type", "gamg"},
+																	   {"-schur_fieldsplit_pressure_ksp_type", "preonly"},
+																	   {"-schur_fieldsplit_pressure_pc_type", "gamg"}};
+		for (const std::pair<const char *, const char *> &option : blockDefaults)
+		{
+			PetscBool isSet;
+			PetscOptionsHasName(NULL, NULL, option.first, &isSet);
+			if (!isSet)
+				PetscOptionsSetValue(NULL, option.first, option.second);
+		}
+		break;
+	}
+	default:
+		KSPSetOptionsPrefix(ksp, "fgmres_lu_");
+		KSPSetType(ksp, KSPFGMRES);
+		KSPSetTolerances(ksp, 1.0e-8, PETSC_DEFAULT, PETSC_DEFAULT, 100);
+		KSPGMRESSetRestart(ksp, 100);
+		PCSetType(pc, PCLU);
+		break;
+	}
+}
+
+void SolidDomain::attachNearNullSpace(Mat &mat, KSP &ksp)
+{
+	// Rigid body modes of the plane problem (two translations and one rotation) at the current nodal positions,
+	// used by algebraic multigrid to build its coarse spaces. The pressure rows are left at zero.
+	// Only the profiles running GAMG on an assembled tangent use them.
+	if (linearSolverProfile_ != SolverProfile::GAMG_CG && linearSolverProfile_ != SolverProfile::FIELDSPLIT_SCHUR)
+		return;
+	PetscBool isShell;
+	PetscObjectTypeCompare((PetscObject)mat, MATSHELL, &isShell);
+	if (isShell)
+		return;
+
+	const int firstRow = firstOwnedRow_;
+	const int n = numberOfOwnedRows_;
+	std::vector<double> modes[3];
+	for (std::vector<double> &mode : modes)
+		mode.assign(n, 0.0);
+
+	for (Node *const &node : nodes_)
+	{
+		if (node->isIsolated())
+			continue;
+		DegreeOfFreedom *const dofX = node->getDegreeOfFreedom(0);
+		DegreeOfFreedom *const dofY = node->getDegreeOfFreedom(1);
+		const int rowX = dofX->getIndex() - firstRow;
+		const int rowY = dofY->getIndex() - firstRow;
+		if (rowX >= 0 && rowX < n)
+		{
+			modes[0][rowX] = 1.0;
+			modes[2][rowX] = -dofY->getCurrentValue();
+		}
+		if (rowY >= 0 && rowY < n)
+		{
+			modes[1][rowY] = 1.0;
+			modes[2][rowY] = dofX->getCurrentValue();
+		}
+	}
+
+	// MatNullSpaceCreate expects orthonormal vectors
+	auto createNullSpace = [](std::vector<double> (&modes)[3], MatNullSpace &nullSpace)
+	{
+		const int size = modes[0].size();
+		for (int k = 0; k < 3; k++)
+		{
+			for (int j = 0; j < k; j++)
+			{
+				double dot = 0.0;
+				for (int i = 0; i < size; i++)
+					dot += modes[k][i] * modes[j][i];
+				MPI_Allreduce(MPI_IN_PLACE, &dot, 1, MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);
+				for (int i = 0; i < size; i++)
+					modes[k][i] -= dot * modes[j][i];
+			}
+			double norm = 0.0;
+			for (int i = 0; i < size; i++)
+				norm += modes[k][i] * modes[k][i];
+			MPI_Allreduce(MPI_IN_PLACE, &norm, 1, MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);
+			norm = 1.0 / std::sqrt(norm);
+			for (int i = 0; i < size; i++)
+				modes[k][i] *= norm;
+		}
+
+		Vec vectors[3];
+		for (int k = 0; k < 3; k++)
+		{
+			VecCreateMPI(PETSC_COMM_WORLD, size, PETSC_DETERMINE, &vectors[k]);
+			double *values;
+			VecGetArray(vectors[k], &values);
+			std::copy(modes[k].begin(), modes[k].end(), values);
+			VecRestoreArray(vectors[k], &values);
+		}
+		MatNullSpaceCreate(PETSC_COMM_WORLD, PETSC_FALSE, 3, vectors, &nullSpace);
+		for (int k = 0; k < 3; k++)
+			VecDestroy(&vectors[k]);
+	};
+
+	MatNullSpace nullSpace;
+	createNullSpace(modes, nullSpace);
+	MatSetNearNullSpace(mat, nullSpace);
+	MatNullSpaceDestroy(&nullSpace);
+
+	// The fieldsplit hands the modes composed with the position split to its position block
+	PC pc;
+	KSPGetPC(ksp, &pc);
+	PetscBool isFieldSplit;
+	PetscObjectTypeCompare((PetscObject)pc, PCFIELDSPLIT, &isFieldSplit);
+	if (isFieldSplit && !pressureIndexes_.empty())
+	{
+		const DOFType *types = dofStore_.getTypes();
+		int m = 0;
+		for (int i = 0; i < n; i++)
+		{
+			if (types[firstRow + i] == DOFType::PRESSURE)
+				continue;
+			for (std::vector<double> &mode : modes)
+				mode[m] = mode[i];
+			m++;
+		}
+		for (std::vector<double> &mode : modes)
+			mode.resize(m);
+
+		IS position;
+		PCFieldSplitGetIS(pc, "position", &position);
+		createNullSpace(modes, nullSpace);
+		PetscObjectCompose((PetscObject)position, "nearnullspace", (PetscObject)nullSpace);
+		MatNullSpaceDestroy(&nullSpace);
+	}
+}
+
+bool SolidDomain::solveLinearSystem(KSP &ksp, Mat &mat, Vec &rhs, Vec &solution, Mat preconditioner)
 {
 	auto start_timer = std::chrono::high_resolution_clock::now();
 
-	KSPSetOperators(ksp, mat, mat);
+	KSPSetOperators(ksp, mat, preconditioner ? preconditioner : mat);
 	PC pc;
 	KSPGetPC(ksp, &pc);
 	PetscBool isbjacobi;
@@ -730,6 +2117,20 @@ void SolidDomain::solveLinearSystem(KSP &ksp, Mat &mat, Vec &rhs, Vec &solution)
 	KSPConvergedReason reason;
 	KSPGetConvergedReason(ksp, &reason);
 
+	// A stale factorization was not good enough for the current tangent: reaching the iteration limit counts as a
+	// failure here, since it is how an outdated LU usually shows up
+	bool refactorized = false;
+	PetscBool reusePreconditioner;
+	KSPGetReusePreconditioner(ksp, &reusePreconditioner);
+	if (reason < 0 && reusePreconditioner)
+	{
+		PetscPrintf(PETSC_COMM_WORLD, "Modified Newton: linear solve with the reused factorization failed (reason %d), refactorizing\n", reason);
+		KSPSetReusePreconditioner(ksp, PETSC_FALSE);
+		KSPSolve(ksp, rhs, solution);
+		KSPGetConvergedReason(ksp, &reason);
+		refactorized = true;
+	}
+
 	auto end_timer = std::chrono::high_resolution_clock::now();
 	std::chrono::duration<double> elapsed = end_timer - start_timer;
 
@@ -744,68 +2145,353 @@ void SolidDomain::solveLinearSystem(KSP &ksp, Mat &mat, Vec &rhs, Vec &solution)
 		PetscPrintf(PETSC_COMM_WORLD, "Diverged, please check PETSc manual. Reason: %d\n", reason);
 		exit(EXIT_FAILURE);
 	}
+	return refactorized;
 }
 
 void SolidDomain::updateVariables(Vec &solution, double &positionNorm, double &pressureNorm)
 {
-	Vec All;
-	VecScatter ctx;
+	// Brings the ghost values of the increment from their owners
+	VecGhostUpdateBegin(solution, INSERT_VALUES, SCATTER_FORWARD);
+	VecGhostUpdateEnd(solution, INSERT_VALUES, SCATTER_FORWARD);
+
+	Vec local;
+	const double *values;
+	VecGhostGetLocalForm(solution, &local);
+	VecGetArrayRead(local, &values);
+
+	// Updates the owned and ghost dofs; the norms are computed from the owned ones only
+	double norms[2] = {0.0, 0.0};
+	const int numberOfLocalDOFs = localDOFs_.size();
+	for (int i = 0; i < numberOfLocalDOFs; i++)
+	{
+		DegreeOfFreedom *dof = localDOFs_[i];
+		if (i < numberOfOwnedRows_)
+			norms[(dof->getType() == DOFType::POSITION) ? 0 : 1] += values[i] * values[i];
+		dof->incrementCurrentValue(values[i]);
+	}
 
-	// Gathers the solution vector to the master process
-	VecScatterCreateToAll(solution, &ctx, &All);
-	VecScatterBegin(ctx, solution, All, INSERT_VALUES, SCATTER_FORWARD);
-	VecScatterEnd(ctx, solution, All, INSERT_VALUES, SCATTER_FORWARD);
-	VecScatterDestroy(&ctx);
+	VecRestoreArrayRead(local, &values);
+	VecGhostRestoreLocalForm(solution, &local);
 
-	// Updates nodal variables
-	positionNorm = 0.0;
-	pressureNorm = 0.0;
+	MPI_Allreduce(MPI_IN_PLACE, norms, 2, MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);
+	positionNorm = sqrt(norms[0]);
+	pressureNorm = sqrt(norms[1]);
+}
 
-	for (Node *const &node : nodes_)
+bool SolidDomain::checkResidualConvergence(Vec &rhs, Vec &lastIncrement, const int &iteration, double &referenceResidual, const double &referenceEnergy)
+{
+	// Called on the assembled residual, with the constrained rows already zeroed, before the linear solve.
+	// The first iteration of a step sets the reference residual; the energy needs the increment of a previous iteration.
+	const ConvergenceCriterion criterion = parameters_->getConvergenceCriterion();
+	const double tolerance = parameters_->getResidualTolerance();
+
+	double residualNorm;
+	VecNorm(rhs, NORM_2, &residualNorm);
+	if (iteration == 0)
+		referenceResidual = residualNorm;
+	double energy = 0.0;
+	if (iteration > 0)
+	{
+		VecDot(lastIncrement, rhs, &energy);
+		energy = std::fabs(energy);
+	}
+	const double relativeResidual = (referenceResidual > 0.0) ? residualNorm / referenceResidual : 0.0;
+	const double relativeEnergy = (referenceEnergy > 0.0) ? energy / referenceEnergy : 0.0;
+
+	PetscPrintf(PETSC_COMM_WORLD, "Newton iteration: %d - Residual: %E - Relative residual: %E - Relative energy: %E\n",
+				iteration, residualNorm, relativeResidual, relativeEnergy);
+
+	switch (criterion)
+	{
+	case ConvergenceCriterion::ABSOLUTE_RESIDUAL:
+		return residualNorm <= tolerance;
+	case ConvergenceCriterion::RELATIVE_RESIDUAL:
+		return iteration > 0 && relativeResidual <= tolerance;
+	case ConvergenceCriterion::ENERGY:
+		return iteration > 0 && relativeEnergy <= tolerance;
+	default:
+		return false;
+	}
+}
+
+double SolidDomain::globalizeNewtonStep(Vec &rhs, Vec &step, Vec &residual, Vec &increment,
+										const std::function<void(Vec &)> &computeResidual,
+										const std::function<void()> &refreshVariables, double &trustRadius,
+										const std::function<double()> &computeEnergy)
+{
+	// Called once the full Newton step has been applied; rhs still holds the residual at the start of the step.
+	// Returns the accepted step length, leaving the state updated accordingly.
+	const Globalization globalization = parameters_->getGlobalization();
+	const int maxIterations = parameters_->getMaxLineSearchIterations();
+
+	double initialNorm, stepNorm, initialSlope;
+	VecNorm(rhs, NORM_2, &initialNorm);
+	VecNorm(step, NORM_2, &stepNorm);
+	VecDot(step, rhs, &initialSlope);
+	initialSlope = -initialSlope;
+
+	double alpha = 1.0;
+	auto moveTo = [&](const double &target)
+	{
+		double positionNorm, pressureNorm;
+		VecCopy(step, increment);
+		VecScale(increment, target - alpha);
+		updateVariables(increment, positionNorm, pressureNorm);
+		refreshVariables();
+		alpha = target;
+	};
+	auto residualNorm = [&]()
+	{
+		double norm;
+		computeResidual(residual);
+		VecNorm(residual, NORM_2, &norm);
+		return norm;
+	};
+
+	int backtracks = 0;
+	double norm = 0.0;
+	switch (globalization)
 	{
-		int ndof = node->getNumberOfDegreesOfFreedom();
-		if (!node->isIsolated())
+	case Globalization::BACKTRACKING:
+	{
+		// Armijo condition on the residual norm; the next length minimizes the quadratic model of 0.5*|R|^2, whose
+		// slope at zero is -|R0|^2 along the Newton direction
+		norm = residualNorm();
+		while (norm > (1.0 - 1.0e-4 * alpha) * initialNorm && backtracks < maxIterations)
+		{
+			const double f0 = 0.5 * initialNorm * initialNorm;
+			const double f = 0.5 * norm * norm;
+			double next = initialNorm * initialNorm * alpha * alpha / (2.0 * (f - f0 + initialNorm * initialNorm * alpha));
+			next = std::min(std::max(next, 0.1 * alpha), 0.5 * alpha);
+			moveTo(next);
+			norm = residualNorm();
+			backtracks++;
+		}
+		PetscPrintf(PETSC_COMM_WORLD, "Line search: step length %E - backtracks %d - residual %E -> %E\n", alpha, backtracks, initialNorm, norm);
+		break;
+	}
+	case Globalization::CRITICAL_POINT:
+	{
+		if (computeEnergy)
 		{
-			for (int j = 0; j < dimension_; j++)
+			// Armijo backtracking on the total potential energy, whose slope at zero is -step.rhs. The next length
+			// minimizes its quadratic interpolation.
+			double trial = 1.0;
+			double energy = computeEnergy();
+			moveTo(0.0);
+			const double initialEnergy = computeEnergy();
+			while (initialSlope < 0.0 && energy > initialEnergy + 1.0e-4 * trial * initialSlope && backtracks < maxIterations)
 			{
-				DegreeOfFreedom *dof = node->getDegreeOfFreedom(j);
-				int index = dof->getIndex();
-				double val;
-				VecGetValues(All, 1, &index, &val);
-				positionNorm += val * val;
-				dof->incrementCurrentValue(val);
+				double next = -initialSlope * trial * trial / (2.0 * (energy - initialEnergy - initialSlope * trial));
+				trial = std::min(std::max(next, 0.1 * trial), 0.5 * trial);
+				moveTo(trial);
+				energy = computeEnergy();
+				backtracks++;
 			}
-			for (int j = dimension_; j < ndof; j++)
+			if (alpha != trial)
+				moveTo(trial);
+			norm = residualNorm();
+			PetscPrintf(PETSC_COMM_WORLD, "Line search: step length %E - backtracks %d - energy %E -> %E - residual %E -> %E\n",
+						alpha, backtracks, initialEnergy, energy, initialNorm, norm);
+			break;
+		}
+
+		// Secant iterations on the directional derivative of the energy, -step.rhs(alpha), which also applies to the
+		// transient and mixed problems
+		double previousAlpha = 0.0;
+		double previousSlope = initialSlope;
+		double slope;
+		computeResidual(residual);
+		VecDot(step, residual, &slope);
+		slope = -slope;
+		while (std::abs(slope) > 0.1 * std::abs(initialSlope) && backtracks < maxIterations)
+		{
+			double next = alpha - slope * (alpha - previousAlpha) / (slope - previousSlope);
+			if (!std::isfinite(next) || next <= 0.0)
+				next = 0.5 * alpha;
+			next = std::min(std::max(next, 0.05), 2.0);
+			previousAlpha = alpha;
+			previousSlope = slope;
+			moveTo(next);
+			computeResidual(residual);
+			VecDot(step, residual, &slope);
+			slope = -slope;
+			backtracks++;
+		}
+		VecNorm(residual, NORM_2, &norm);
+		PetscPrintf(PETSC_COMM_WORLD, "Line search: step length %E - secant iterations %d - residual %E -> %E\n", alpha, backtracks, initialNorm, norm);
+		break;
+	}
+	case Globalization::TRUST_REGION:
+	{
+		// The linear model predicts |R(alpha)| = (1 - alpha)|R0| along the Newton step
+		if (trustRadius <= 0.0)
+			trustRadius = stepNorm;
+		const double target = std::min(1.0, trustRadius / stepNorm);
+		if (target < 1.0)
+			moveTo(target);
+		while (true)
+		{
+			norm = residualNorm();
+			const double ratio = (initialNorm - norm) / (alpha * initialNorm);
+			if (ratio < 0.25)
+				trustRadius = 0.25 * alpha * stepNorm;
+			else if (ratio > 0.75 && alpha * stepNorm >= 0.99 * trustRadius)
+				trustRadius *= 2.0;
+			if (ratio > 0.0 || backtracks >= maxIterations)
+				break;
+			moveTo(std::min(1.0, trustRadius / stepNorm));
+			backtracks++;
+		}
+		PetscPrintf(PETSC_COMM_WORLD, "Trust region: step length %E - rejected %d - radius %E - residual %E -> %E\n", alpha, backtracks, trustRadius, initialNorm, norm);
+		break;
+	}
+	default:
+		break;
+	}
+	return alpha;
+}
+
+void SolidDomain::gatherNodalVariables(const bool &toAllRanks)
+{
+	// Each rank only keeps its own and ghost dofs up to date. Before the output (rank 0) or the coupling with
+	// other domains (every rank) the current values and time derivatives of the owned dofs are gathered.
+	int size;
+	MPI_Comm_size(PETSC_COMM_WORLD, &size);
+	if (size == 1)
+		return;
+
+	if (systemPatternOutdated_)
+		buildSystemPattern();
+
+	Vec owned, gathered;
+	VecScatter ctx;
+	createOwnedNodalVariables(owned);
+
+	if (toAllRanks)
+		VecScatterCreateToAll(owned, &ctx, &gathered);
+	else
+		VecScatterCreateToZero(owned, &ctx, &gathered);
+	VecScatterBegin(ctx, owned, gathered, INSERT_VALUES, SCATTER_FORWARD);
+	VecScatterEnd(ctx, owned, gathered, INSERT_VALUES, SCATTER_FORWARD);
+	VecScatterDestroy(&ctx);
+
+	int rank;
+	MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
+	if (toAllRanks || rank == 0)
+	{
+		const double *all;
+		VecGetArrayRead(gathered, &all);
+		for (Node *const &node : nodes_)
+		{
+			if (node->isIsolated())
+				continue;
+			for (DegreeOfFreedom *const &dof : node->getDegreesOfFreedom())
 			{
-				DegreeOfFreedom *dof = node->getDegreeOfFreedom(j);
 				int index = dof->getIndex();
-				double val;
-				VecGetValues(All, 1, &index, &val);
-				pressureNorm += val * val;
-				dof->incrementCurrentValue(val);
+				dof->setCurrentValue(all[3 * index]);
+				dof->setCurrentFirstTimeDerivative(all[3 * index + 1]);
+				dof->setCurrentSecondTimeDerivative(all[3 * index + 2]);
 			}
 		}
+		VecRestoreArrayRead(gathered, &all);
+	}
+
+	VecDestroy(&gathered);
+	VecDestroy(&owned);
+}
+
+void SolidDomain::createOwnedNodalVariables(Vec &owned)
+{
+	// Current value and time derivatives of the owned dofs, interleaved and in index order
+	VecCreateMPI(PETSC_COMM_WORLD, 3 * numberOfOwnedRows_, 3 * numberOfBlockedDOFs_, &owned);
+
+	double *values;
+	VecGetArray(owned, &values);
+	for (int i = 0; i < numberOfOwnedRows_; i++)
+	{
+		DegreeOfFreedom *dof = localDOFs_[i];
+		values[3 * i] = dof->getCurrentValue();
+		values[3 * i + 1] = dof->getCurrentFirstTimeDerivative();
+		values[3 * i + 2] = dof->getCurrentSecondTimeDerivative();
+	}
+	VecRestoreArray(owned, &values);
+}
+
+void SolidDomain::gatherNodalVariables(const std::vector<DegreeOfFreedom *> &dofs)
+{
+	// Brings to rank 0 only the listed dofs (the lists of the other ranks are ignored), for the outputs that read a
+	// handful of nodes. Collective.
+	int size, rank;
+	MPI_Comm_size(PETSC_COMM_WORLD, &size);
+	MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
+	if (size == 1)
+		return;
+
+	if (systemPatternOutdated_)
+		buildSystemPattern();
+
+	std::vector<PetscInt> indexes;
+	if (rank == 0)
+	{
+		indexes.reserve(3 * dofs.size());
+		for (DegreeOfFreedom *const &dof : dofs)
+			for (int k = 0; k < 3; k++)
+				indexes.push_back(3 * dof->getIndex() + k);
+	}
+
+	Vec owned, gathered;
+	VecScatter ctx;
+	IS from;
+	createOwnedNodalVariables(owned);
+	ISCreateGeneral(PETSC_COMM_SELF, indexes.size(), indexes.data(), PETSC_COPY_VALUES, &from);
+	VecCreateSeq(PETSC_COMM_SELF, indexes.size(), &gathered);
+	VecScatterCreate(owned, from, gathered, NULL, &ctx);
+	VecScatterBegin(ctx, owned, gathered, INSERT_VALUES, SCATTER_FORWARD);
+	VecScatterEnd(ctx, owned, gathered, INSERT_VALUES, SCATTER_FORWARD);
+	VecScatterDestroy(&ctx);
+	ISDestroy(&from);
+
+	if (rank == 0)
+	{
+		const double *values;
+		VecGetArrayRead(gathered, &values);
+		for (unsigned int i = 0; i < dofs.size(); i++)
+		{
+			dofs[i]->setCurrentValue(values[3 * i]);
+			dofs[i]->setCurrentFirstTimeDerivative(values[3 * i + 1]);
+			dofs[i]->setCurrentSecondTimeDerivative(values[3 * i + 2]);
+		}
+		VecRestoreArrayRead(gathered, &values);
 	}
 
-	positionNorm = sqrt(positionNorm);
-	pressureNorm = sqrt(pressureNorm);
-	VecDestroy(&All);
+	VecDestroy(&gathered);
+	VecDestroy(&owned);
 }
 
 void SolidDomain::computeCauchyStress()
 {
+	// Nodal average over the elements of all ranks: the sums of the local elements and their number are added over
+	// the halo in a ghosted vector with one block per dof, where each node uses the block of its first dof
+	int rank;
+	MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
+
+	if (systemPatternOutdated_)
+		buildSystemPattern();
+
 	const unsigned int numberOfNodes = nodes_.size();
-	int *nodalContribution = new int[numberOfNodes];
-	for (int i = 0; i < numberOfNodes; i++)
-		nodalContribution[i] = 0;
+	stressContributions_.assign(numberOfNodes, 0);
 
 	const int numberOfStressComponents = dimension_ * (dimension_ + 1) / 2;
+	const int bs = numberOfStressComponents + 1;
 
 	for (Node *&node : nodes_)
 		node->clearCauchyStress(numberOfStressComponents);
 
 	for (Element *&el : elements_)
 	{
+		if (el->getRank() != rank)
+			continue;
 		double **cauchyStress;
 		el->getCauchyStress(cauchyStress);
 		const std::vector<Node *> &nodes = el->getNodes();
@@ -814,33 +2500,167 @@ void SolidDomain::computeCauchyStress()
 		{
 			int index = nodes[i]->getIndex();
 			nodes_[index]->incrementCauchyStress(numberOfStressComponents, cauchyStress[i]);
-			nodalContribution[index]++;
+			stressContributions_[index]++;
 			delete[] cauchyStress[i];
 		}
 		delete[] cauchyStress;
 	}
 
-	for (int i = 0; i < numberOfNodes; i++)
+	Vec sums, sumsLocal;
+	double *values;
+	VecCreateGhostBlock(PETSC_COMM_WORLD, bs, bs * numberOfOwnedRows_, bs * numberOfBlockedDOFs_, ghostIndexes_.size(), ghostIndexes_.data(), &sums);
+	VecGhostGetLocalForm(sums, &sumsLocal);
+	VecSet(sumsLocal, 0.0);
+	VecGetArray(sumsLocal, &values);
+	for (unsigned int i = 0; i < numberOfNodes; i++)
 	{
+		const int row = getLocalRow(nodes_[i]->getDegreeOfFreedom(0)->getIndex());
+		if (row < 0 || stressContributions_[i] == 0)
+			continue;
+		const double *cauchy = nodes_[i]->getCauchyStress();
+		for (int j = 0; j < numberOfStressComponents; j++)
+			values[bs * row + j] = cauchy[j];
+		values[bs * row + numberOfStressComponents] = stressContributions_[i];
+	}
+	VecRestoreArray(sumsLocal, &values);
+	VecGhostRestoreLocalForm(sums, &sumsLocal);
+	VecGhostUpdateBegin(sums, ADD_VALUES, SCATTER_REVERSE);
+	VecGhostUpdateEnd(sums, ADD_VALUES, SCATTER_REVERSE);
+	VecGhostUpdateBegin(sums, INSERT_VALUES, SCATTER_FORWARD);
+	VecGhostUpdateEnd(sums, INSERT_VALUES, SCATTER_FORWARD);
+
+	VecGhostGetLocalForm(sums, &sumsLocal);
+	VecGetArray(sumsLocal, &values);
+	for (unsigned int i = 0; i < numberOfNodes; i++)
+	{
+		const int row = getLocalRow(nodes_[i]->getDegreeOfFreedom(0)->getIndex());
+		if (row < 0)
+			continue;
 		double *cauchy = nodes_[i]->getCauchyStress();
 		for (int j = 0; j < numberOfStressComponents; j++)
-			cauchy[j] /= nodalContribution[i];
+			cauchy[j] = values[bs * row + j];
+		stressContributions_[i] = static_cast<int>(values[bs * row + numberOfStressComponents] + 0.5);
+	}
+	VecRestoreArray(sumsLocal, &values);
+	VecGhostRestoreLocalForm(sums, &sumsLocal);
+	VecDestroy(&sums);
+
+	for (unsigned int i = 0; i < numberOfNodes; i++)
+	{
+		if (stressContributions_[i] == 0)
+			continue;
+		double *cauchy = nodes_[i]->getCauchyStress();
+		for (int j = 0; j < numberOfStressComponents; j++)
+			cauchy[j] /= stressContributions_[i];
 	}
-	delete[] nodalContribution;
 }
 
 void SolidDomain::computeInitialAccel()
 {
 }
 
-void SolidDomain::exportGraphicData(const int &timeStep)
+double SolidDomain::computeStableTimeStep()
 {
-	// Implemented only for 2D problems
+	// Courant limit min(h / c) over the local elements, with the dilatational wave speed of the solid and h the
+	// element area over its circumradius (the inradius scale, which vanishes for slivers), divided by the order
+	int rank;
+	MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
 
-	double deltat = parameters_->getDeltat();
+	double stableDeltat = std::numeric_limits<double>::max();
+	for (Element *const &el : elements_)
+	{
+		if (el->getRank() != rank || !el->isActive())
+			continue;
+		// The materials are checked by solveExplicitProblem before the time loop
+		const ElasticSolid *solid = static_cast<const ElasticSolid *>(el->getMaterial());
+		const double young = solid->getYoung();
+		const double poisson = solid->getPoisson();
+		const double modulus = (solid->getPlaneAnalysis() == PLANE_STRAIN)
+								   ? young * (1.0 - poisson) / ((1.0 + poisson) * (1.0 - 2.0 * poisson))
+								   : young / (1.0 - poisson * poisson);
+		const double waveSpeed = sqrt(modulus / solid->getDensity());
+
+		const BaseSurfaceElement *base = static_cast<const BaseSurfaceElement *>(el->getBaseElement());
+		const ParametricElement *parametric = base->getParametricElement();
+		const double area = base->getJacobianIntegration();
+		double length;
+		switch (parametric->getElementType())
+		{
+		case T3:
+		case T6:
+		case T10:
+			length = area / base->getRadius();
+			break;
+		default:
+			length = sqrt(area);
+			break;
+		}
+		stableDeltat = std::min(stableDeltat, length / (parametric->getOrder() * waveSpeed));
+	}
+	MPI_Allreduce(MPI_IN_PLACE, &stableDeltat, 1, MPI_DOUBLE, MPI_MIN, PETSC_COMM_WORLD);
+	return parameters_->getExplicitCourantNumber() * stableDeltat;
+}
+
+void SolidDomain::exportGraphicData(const double &time)
+{
+	// Implemented only for 2D problems. The first column is the time, or the load factor in static analyses.
+	// Collective: rank 0 gathers only the dofs it reads and the nodal stresses of the plotted nodes, while the element
+	// energies are reduced from the local elements of every rank
+	int rank;
+	MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
 
+	std::vector<DegreeOfFreedom *> readDOFs;
 	for (auto &outputGraphic : outputGraphics_)
+		for (DegreeOfFreedom *const &dof : outputGraphic->getNode()->getDegreesOfFreedom())
+			readDOFs.push_back(dof);
+	for (NeumannBoundaryCondition *const &nbc : neumannBoundaryConditions_)
+	{
+		std::vector<DegreeOfFreedom *> dofs;
+		double *values;
+		nbc->getNodalForce(dimension_, dofs, values);
+		readDOFs.insert(readDOFs.end(), dofs.begin(), dofs.end());
+		delete[] values;
+	}
+	gatherNodalVariables(readDOFs);
+
+	// The nodal stresses are already averaged over all ranks: each one is sent by the rank owning its first dof
+	const int numberOfGraphics = outputGraphics_.size();
+	std::vector<double> stresses(numberOfGraphics, 0.0);
+	for (int i = 0; i < numberOfGraphics; i++)
+	{
+		if (outputGraphics_[i]->getVariable() != CAUCHY_STRESS || stressContributions_.size() != nodes_.size())
+			continue;
+		Node *node = outputGraphics_[i]->getNode();
+		const int index = node->getDegreeOfFreedom(0)->getIndex();
+		if (index < firstOwnedRow_ || index >= firstOwnedRow_ + numberOfOwnedRows_ || stressContributions_[node->getIndex()] == 0)
+			continue;
+		ConstrainedDOF direction = outputGraphics_[i]->getConstrainedDOF();
+		const int dir = (direction == X) ? 0 : ((direction == Y) ? 1 : 2);
+		stresses[i] = node->getCauchyStress()[dir];
+	}
+	MPI_Reduce((rank == 0) ? MPI_IN_PLACE : stresses.data(), stresses.data(), numberOfGraphics, MPI_DOUBLE, MPI_SUM, 0, PETSC_COMM_WORLD);
+
+	// Energy
+	double energies[3] = {0.0, 0.0, 0.0}; // strain, kinect and domain force potential
+	for (Element *&el : elements_)
 	{
+		if (el->getRank() != rank)
+			continue;
+		double strainEnergy, kinectEnergy, domainForcePotentialEnergy;
+		el->getEnergy(strainEnergy, kinectEnergy, domainForcePotentialEnergy);
+		energies[0] += strainEnergy;
+		energies[1] += kinectEnergy;
+		energies[2] += domainForcePotentialEnergy;
+	}
+	MPI_Reduce((rank == 0) ? MPI_IN_PLACE : energies, energies, 3, MPI_DOUBLE, MPI_SUM, 0, PETSC_COMM_WORLD);
+	if (rank != 0)
+		return;
+
+	// The rows are buffered by the recorder and handed in blocks to the output thread
+	std::vector<double> values;
+	for (int g = 0; g < numberOfGraphics; g++)
+	{
+		OutputGraphic *outputGraphic = outputGraphics_[g];
 		Node *node = outputGraphic->getNode();
 		Variable variable = outputGraphic->getVariable();
 		ConstrainedDOF direction = outputGraphic->getConstrainedDOF();
@@ -852,163 +2672,98 @@ void SolidDomain::exportGraphicData(const int &timeStep)
 		if (direction == Z)
 			dir = 2;
 
-		std::string name = outputGraphic->getFileName();
-		std::string filePath = "plotData/" + name + ".dat";
-		std::ofstream file(filePath, std::ios::app);
-
-		if (!file.fail())
-		{
-			file.precision(8);
-			file.setf(std::ios::scientific, std::ios::floatfield);
-			file.width(20);
-			file << std::left << deltat * double(timeStep);
-			file.width(20);
-			if (variable == DISPLACEMENT)
-				file << std::left << node->getDegreeOfFreedom(dir)->getCurrentValue() - node->getDegreeOfFreedom(dir)->getInitialValue();
-			if (variable == VELOCITY)
-				file << std::left << node->getDegreeOfFreedom(dir)->getCurrentFirstTimeDerivative();
-			if (variable == CAUCHY_STRESS)
-			{
-				double *cauchyStress = node->getCauchyStress();
-				file << std::left << cauchyStress[dir];
-			}
-			file << "\n";
-			file.close();
-		}
-		else
-		{
-			file.close();
-			std::cerr << "\nCan't open the file '" << filePath << "'.\n";
-			exit(EXIT_FAILURE);
-		}
+		double value = 0.0;
+		if (variable == DISPLACEMENT)
+			value = node->getDegreeOfFreedom(dir)->getCurrentValue() - node->getDegreeOfFreedom(dir)->getInitialValue();
+		if (variable == VELOCITY)
+			value = node->getDegreeOfFreedom(dir)->getCurrentFirstTimeDerivative();
+		if (variable == CAUCHY_STRESS)
+			value = stresses[g];
+		values.push_back(value);
 	}
 
-	// Energy
-	double totalStrainEnergy = 0.0;
-	double totalKinectEnergy = 0.0;
-	double totalExternalPotentialEnergy = 0.0;
-	for (Element *&el : elements_)
-	{
-		double strainEnergy, kinectEnergy, domainForcePotentialEnergy;
-		el->getEnergy(strainEnergy, kinectEnergy, domainForcePotentialEnergy);
-		totalStrainEnergy += strainEnergy;
-		totalKinectEnergy += kinectEnergy;
-		totalExternalPotentialEnergy += domainForcePotentialEnergy;
-	}
+	double totalStrainEnergy = energies[0];
+	double totalKinectEnergy = energies[1];
+	double totalExternalPotentialEnergy = energies[2];
 	double surfaceForcePotentialEnergy = getSurfaceForcesPotentialEnergy();
 	totalExternalPotentialEnergy += surfaceForcePotentialEnergy;
 
 	double totalEnergy = totalStrainEnergy + totalKinectEnergy - totalExternalPotentialEnergy;
 
-	// std::cout << "\nDeformation energy = " << totalDeformationEnergy << std::endl;
-	// std::cout << "Kinect energy = " << totalKinectEnergy << std::endl;
-	// std::cout << "External potential energy = " << totalExternalPotentialEnergy << std::endl;
-	// std::cout << "Total energy = " << totalEnergy << std::endl;
+	values.push_back(totalStrainEnergy);
+	values.push_back(totalKinectEnergy);
+	values.push_back(-totalExternalPotentialEnergy);
+	values.push_back(totalEnergy);
 
-	// Strain Energy
-	std::ofstream file1("plotData/strain-energy.dat", std::ios::app);
-	if (!file1.fail())
+	if (!timeSeries_)
 	{
-		file1.precision(8);
-		file1.setf(std::ios::scientific, std::ios::floatfield);
-		file1.width(20);
-		file1 << std::left << deltat * double(timeStep);
-		file1.width(20);
-		file1 << std::left << totalStrainEnergy;
-		file1 << "\n";
-		file1.close();
-	}
-	else
-	{
-		file1.close();
-		std::cerr << "\nCan't open the file '" << "plotData/strain-energy.dat" << "'.\n";
-		exit(EXIT_FAILURE);
-	}
-
-	// Kinect Energy
-	std::ofstream file2("plotData/kinect-energy.dat", std::ios::app);
-	if (!file2.fail())
-	{
-		file2.precision(8);
-		file2.setf(std::ios::scientific, std::ios::floatfield);
-		file2.width(20);
-		file2 << std::left << deltat * double(timeStep);
-		file2.width(20);
-		file2 << std::left << totalKinectEnergy;
-		file2 << "\n";
-		file2.close();
-	}
-	else
-	{
-		file2.close();
-		std::cerr << "\nCan't open the file '" << "plotData/kinect-energy.dat" << "'.\n";
-		exit(EXIT_FAILURE);
-	}
-
-	// Potential External Energy
-	std::ofstream file3("plotData/external-energy.dat", std::ios::app);
-	if (!file3.fail())
-	{
-		file3.precision(8);
-		file3.setf(std::ios::scientific, std::ios::floatfield);
-		file3.width(20);
-		file3 << std::left << deltat * double(timeStep);
-		file3.width(20);
-		file3 << std::left << -totalExternalPotentialEnergy;
-		file3 << "\n";
-		file3.close();
-	}
-	else
-	{
-		file3.close();
-		std::cerr << "\nCan't open the file '" << "plotData/external-energy.dat" << "'.\n";
-		exit(EXIT_FAILURE);
+		std::vector<std::string> names;
+		for (OutputGraphic *const &outputGraphic : outputGraphics_)
+			names.push_back(outputGraphic->getFileName());
+		names.insert(names.end(), {"strain-energy", "kinect-energy", "external-energy", "total-energy"});
+		timeSeries_ = new TimeSeriesRecorder("plotData", names, parameters_->useBinaryTimeSeries());
 	}
+	timeSeries_->addRow(time, values);
+	if (timeSeries_->getNumberOfBufferedRows() >= parameters_->getTimeSeriesBufferRows())
+		writeTimeSeries();
+}
 
-	// Total Energy
-	std::ofstream file4("plotData/total-energy.dat", std::ios::app);
-	if (!file4.fail())
-	{
-		file4.precision(8);
-		file4.setf(std::ios::scientific, std::ios::floatfield);
-		file4.width(20);
-		file4 << std::left << deltat * double(timeStep);
-		file4.width(20);
-		file4 << std::left << totalEnergy;
-		file4 << "\n";
-		file4.close();
-	}
-	else
+void SolidDomain::writeTimeSeries()
+{
+	if (!timeSeries_ || timeSeries_->getNumberOfBufferedRows() == 0)
+		return;
+	TimeSeriesRecorder *timeSeries = timeSeries_;
+	std::shared_ptr<std::vector<double>> rows = std::make_shared<std::vector<double>>(timeSeries_->takeRows());
+	auto write = [timeSeries, rows]()
 	{
-		file4.close();
-		std::cerr << "\nCan't open the file '" << "plotData/external-energy.dat" << "'.\n";
-		exit(EXIT_FAILURE);
-	}
+		timeSeries->write(*rows);
+	};
+	queueOutput(write);
 }
 
 void SolidDomain::exportToParaview(const int &step)
 {
+	// Collective. Each rank writes a piece with its local elements and the nodes they reference, and rank 0 the
+	// .pvtu that joins them, so the solution is never brought to a single rank. The line elements and the isolated
+	// nodes only appear in the single .vtu of serial runs. In the XDMF format the same pieces are appended to the
+	// HDF5 time series instead
+	int rank, size;
+	MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
+	MPI_Comm_size(PETSC_COMM_WORLD, &size);
+
 	std::stringstream text;
-	text << "results/"
-		 << "solidOutput" << step << ".vtu";
-	std::ofstream file(text.str());
+	text << "solidOutput" << step;
 
-	unsigned int numberOfElements = 0;
-	for (const auto &pair : geometry_->getLines())
+	// Every field is gathered into a contiguous buffer and handed to the writer, which writes it in one go
+	std::vector<BaseElement *> plotElements;
+	std::vector<Node *> plotNodes;
+	std::vector<int> pointIndex(nodes_.size(), -1);
+	if (size == 1)
 	{
-		Line *line = pair.second;
-		const std::vector<BaseLineElement *> &elements = line->getBaseElements();
-		for (auto &elem : elements)
-			if (elem->getPlot())
-				numberOfElements++;
+		for (const auto &pair : geometry_->getLines())
+			for (BaseLineElement *const &elem : pair.second->getBaseElements())
+				if (elem->getPlot())
+					plotElements.push_back(elem);
+		for (const auto &pair : geometry_->getSurfaces())
+			for (BaseSurfaceElement *const &elem : pair.second->getBaseElements())
+				if (elem->getPlot())
+					plotElements.push_back(elem);
+		plotNodes = nodes_;
+		for (unsigned int n = 0; n < nodes_.size(); n++)
+			pointIndex[n] = n;
 	}
-	for (const auto &pair : geometry_->getSurfaces())
+	else
 	{
-		Surface *surface = pair.second;
-		const std::vector<BaseSurfaceElement *> &elements = surface->getBaseElements();
-		for (auto &elem : elements)
-			if (elem->getPlot())
-				numberOfElements++;
+		for (Element *const &el : elements_)
+			if (el->getRank() == rank && el->getBaseElement()->getPlot())
+				plotElements.push_back(el->getBaseElement());
+		for (BaseElement *const &elem : plotElements)
+			for (Node *const &node : elem->getNodes())
+				if (pointIndex[node->getIndex()] < 0)
+				{
+					pointIndex[node->getIndex()] = plotNodes.size();
+					plotNodes.push_back(node);
+				}
 	}
 
 	bool mixed = false;
@@ -1016,257 +2771,142 @@ void SolidDomain::exportToParaview(const int &step)
 		materials_[0]->getType() == MaterialType::NEWTONIAN_INCOMPRESSIBLE_FLUID)
 		mixed = true;
 
-	// header
-	file << "<?xml version=\"1.0\"?>"
-		 << "\n"
-		 << "<VTKFile type=\"UnstructuredGrid\">"
-		 << "\n"
-		 << "  <UnstructuredGrid>"
-		 << "\n"
-		 << "  <Piece NumberOfPoints=\"" << nodes_.size()
-		 << "\"  NumberOfCells=\"" << numberOfElements
-		 << "\">"
-		 << "\n";
-
-	// nodal coordinates
-	file << "    <Points>"
-		 << "\n"
-		 << "      <DataArray type=\"Float64\" "
-		 << "NumberOfComponents=\"" << 3 << "\" format=\"ascii\">"
-		 << "\n";
-	for (Node *&n : nodes_)
-	{
-		std::vector<DegreeOfFreedom *> dofs = n->getDegreesOfFreedom();
-		file << dofs[0]->getCurrentValue() << " " << dofs[1]->getCurrentValue() << " " << ((dimension_ == 3) ? dofs[2]->getCurrentValue() : 0.0) << "\n";
-	}
-	file << "      </DataArray>"
-		 << "\n"
-		 << "    </Points>"
-		 << "\n";
-
-	// element connectivity
-	file << "    <Cells>"
-		 << "\n"
-		 << "      <DataArray type=\"Int32\" "
-		 << "Name=\"connectivity\" format=\"ascii\">"
-		 << "\n";
-	for (const auto &pair : geometry_->getLines())
-	{
-		Line *line = pair.second;
-		const std::vector<BaseLineElement *> &elements = line->getBaseElements();
-		for (auto &elem : elements)
-		{
-			if (elem->getPlot())
-			{
-				ParametricElement *parametricElement = elem->getParametricElement();
-				const std::vector<int> &vtkConnectivity = parametricElement->getVTKConnectivity();
-				const std::vector<Node *> &nodes = elem->getNodes();
-				const unsigned int numberOfNodes = nodes.size();
-				for (unsigned int i = 0; i < numberOfNodes; i++)
-				{
-					int nodeIndex = vtkConnectivity[i];
-					file << nodes[nodeIndex]->getIndex() << " ";
-				}
-				file << "\n";
-			}
-		}
-	}
-	for (const auto &pair : geometry_->getSurfaces())
-	{
-		Surface *surface = pair.second;
-		const std::vector<BaseSurfaceElement *> &elements = surface->getBaseElements();
-		for (auto &elem : elements)
-		{
-			if (elem->getPlot())
-			{
-				ParametricElement *parametricElement = elem->getParametricElement();
-				const std::vector<int> &vtkConnectivity = parametricElement->getVTKConnectivity();
-				const std::vector<Node *> &nodes = elem->getNodes();
-				const unsigned int numberOfNodes = nodes.size();
-				for (int i = 0; i < numberOfNodes; i++)
-				{
-					int nodeIndex = vtkConnectivity[i];
-					file << nodes[nodeIndex]->getIndex() << " ";
-				}
-				file << "\n";
-			}
-		}
-	}
-
-	file << "      </DataArray>"
-		 << "\n";
+	VTUWriter writer(parameters_->getParaviewFormat());
 
-	// offsets
-	file << "      <DataArray type=\"Int32\""
-		 << " Name=\"offsets\" format=\"ascii\">"
-		 << "\n";
-	int aux = 0;
-	for (const auto &pair : geometry_->getLines())
+	// nodal coordinates
+	const unsigned int numberOfNodes = plotNodes.size();
+	std::vector<double> coordinates(3 * numberOfNodes);
+	for (unsigned int n = 0; n < numberOfNodes; n++)
 	{
-		Line *line = pair.second;
-		const std::vector<BaseLineElement *> &elements = line->getBaseElements();
-		for (auto &elem : elements)
-		{
-			if (elem->getPlot())
-			{
-				aux += elem->getNumberOfNodes();
-				file << aux << "\n";
-			}
-		}
+		coordinates[3 * n] = plotNodes[n]->getDegreeOfFreedom(0)->getCurrentValue();
+		coordinates[3 * n + 1] = plotNodes[n]->getDegreeOfFreedom(1)->getCurrentValue();
+		coordinates[3 * n + 2] = (dimension_ == 3) ? plotNodes[n]->getDegreeOfFreedom(2)->getCurrentValue() : 0.0;
 	}
-	for (const auto &pair : geometry_->getSurfaces())
+	writer.setPoints(coordinates);
+
+	// element connectivity, offsets and types
+	std::vector<int32_t> connectivity, offsets;
+	std::vector<uint8_t> types;
+	offsets.reserve(plotElements.size());
+	types.reserve(plotElements.size());
+	for (BaseElement *const &elem : plotElements)
 	{
-		Surface *surface = pair.second;
-		const std::vector<BaseSurfaceElement *> &elements = surface->getBaseElements();
-		for (auto &elem : elements)
-		{
-			if (elem->getPlot())
-			{
-				aux += elem->getNumberOfNodes();
-				file << aux << "\n";
-			}
-		}
+		ParametricElement *parametricElement = elem->getParametricElement();
+		const std::vector<int> &vtkConnectivity = parametricElement->getVTKConnectivity();
+		const std::vector<Node *> &nodes = elem->getNodes();
+		for (unsigned int i = 0; i < nodes.size(); i++)
+			connectivity.push_back(pointIndex[nodes[vtkConnectivity[i]]->getIndex()]);
+		offsets.push_back(connectivity.size());
+		types.push_back(parametricElement->getVTKCellType());
 	}
+	const unsigned int numberOfCells = plotElements.size();
+	writer.setCells(connectivity, offsets, types);
 
-	file << "      </DataArray>"
-		 << "\n";
-
-	// elements type
-	file << "      <DataArray type=\"UInt8\" Name=\"types\" "
-		 << "format=\"ascii\">"
-		 << "\n";
-	for (const auto &pair : geometry_->getLines())
+	// nodal results
+	std::vector<double> displacement(dimension_ * numberOfNodes), velocity(dimension_ * numberOfNodes), acceleration(dimension_ * numberOfNodes);
+	const int numberOfStressComponents = dimension_ * (dimension_ + 1) / 2;
+	std::vector<double> cauchyStress(numberOfStressComponents * numberOfNodes), permutedIndex(numberOfNodes);
+	std::vector<double> pressure(mixed ? numberOfNodes : 0);
+	for (unsigned int n = 0; n < numberOfNodes; n++)
 	{
-		Line *line = pair.second;
-		const std::vector<BaseLineElement *> &elements = line->getBaseElements();
-		for (auto &elem : elements)
+		Node *node = plotNodes[n];
+		for (int i = 0; i < dimension_; i++)
 		{
-			if (elem->getPlot())
-			{
-				ParametricElement *parametricElement = elem->getParametricElement();
-				VTKCellType vtkType = parametricElement->getVTKCellType();
-				file << vtkType << "\n";
-			}
+			const DegreeOfFreedom *dof = node->getDegreeOfFreedom(i);
+			displacement[dimension_ * n + i] = dof->getCurrentValue() - dof->getInitialValue();
+			velocity[dimension_ * n + i] = dof->getCurrentFirstTimeDerivative();
+			acceleration[dimension_ * n + i] = dof->getCurrentSecondTimeDerivative();
 		}
+		const double *stress = node->getCauchyStress();
+		for (int i = 0; i < numberOfStressComponents; i++)
+			cauchyStress[numberOfStressComponents * n + i] = stress[i];
+		if (mixed)
+			pressure[n] = node->getDegreeOfFreedom(dimension_)->getCurrentValue();
+		permutedIndex[n] = node->getPermutedIndex();
 	}
-	for (const auto &pair : geometry_->getSurfaces())
+	writer.addPointData("Displacement", dimension_, displacement);
+	writer.addPointData("Velocity", dimension_, velocity);
+	writer.addPointData("Acceleration", dimension_, acceleration);
+	writer.addPointData("CauchyStress", numberOfStressComponents, cauchyStress);
+	if (mixed)
+		writer.addPointData("Pressure", 1, pressure);
+	writer.addPointData("PermutedIndex", 1, permutedIndex);
+
+	// elemental results
+	std::vector<double> ranks(numberOfCells, rank);
+	writer.addCellData("Rank", 1, ranks);
+
+#ifdef HAVE_HDF5
+	if (parameters_->getResultsFormat() == ResultsFormat::XDMF)
 	{
-		Surface *surface = pair.second;
-		const std::vector<BaseSurfaceElement *> &elements = surface->getBaseElements();
-		for (auto &elem : elements)
+		if (!xdmfWriter_)
+			xdmfWriter_ = new XDMFWriter("results/solidOutput", PETSC_COMM_WORLD, dimension_);
+		std::shared_ptr<XDMFWriter::Step> snapshot = xdmfWriter_->prepareStep(parameters_->getCurrentTime(), writer);
+		if (xdmfWriter_->isParallel())
+			xdmfWriter_->writeStep(*snapshot); // collective, so not on the output thread
+		else if (snapshot)
 		{
-			if (elem->getPlot())
+			XDMFWriter *xdmfWriter = xdmfWriter_;
+			auto write = [xdmfWriter, snapshot]()
 			{
-				ParametricElement *parametricElement = elem->getParametricElement();
-				VTKCellType vtkType = parametricElement->getVTKCellType();
-				file << vtkType << "\n";
-			}
+				xdmfWriter->writeStep(*snapshot);
+			};
+			queueOutput(write);
 		}
+		return;
 	}
+#endif
 
-	file << "      </DataArray>"
-		 << "\n"
-		 << "    </Cells>"
-		 << "\n";
-
-	// nodal results
-	file << "    <PointData>"
-		 << "\n";
-	file << "      <DataArray type=\"Float64\" NumberOfComponents=\"" << dimension_ << "\" "
-		 << "Name=\"Displacement\" format=\"ascii\">"
-		 << "\n";
-	for (Node *&n : nodes_)
-	{
-		const std::vector<DegreeOfFreedom *> &dofs = n->getDegreesOfFreedom();
-		for (int i = 0; i < dimension_; i++)
-			file << dofs[i]->getCurrentValue() - dofs[i]->getInitialValue() << " ";
-		file << "\n";
-	}
-	file << "      </DataArray> "
-		 << "\n";
-	file << "      <DataArray type=\"Float64\" NumberOfComponents=\"" << dimension_ << "\" "
-		 << "Name=\"Velocity\" format=\"ascii\">"
-		 << "\n";
-	for (Node *&n : nodes_)
+	// The writer owns the snapshot, the files are written by the output thread
+	std::shared_ptr<VTUWriter> snapshot = std::make_shared<VTUWriter>(std::move(writer));
+	if (size == 1)
 	{
-		const std::vector<DegreeOfFreedom *> &dofs = n->getDegreesOfFreedom();
-		for (int i = 0; i < dimension_; i++)
-			file << dofs[i]->getCurrentFirstTimeDerivative() << " ";
-		file << "\n";
-	}
-	file << "      </DataArray> "
-		 << "\n";
-	file << "      <DataArray type=\"Float64\" NumberOfComponents=\"" << dimension_ << "\" "
-		 << "Name=\"Acceleration\" format=\"ascii\">"
-		 << "\n";
-	for (Node *&n : nodes_)
-	{
-		const std::vector<DegreeOfFreedom *> &dofs = n->getDegreesOfFreedom();
-		for (int i = 0; i < dimension_; i++)
-			file << dofs[i]->getCurrentSecondTimeDerivative() << " ";
-		file << "\n";
-	}
-	file << "      </DataArray> "
-		 << "\n";
-	file << "      <DataArray type=\"Float64\" NumberOfComponents=\"" << dimension_ * (dimension_ + 1) / 2 << "\" "
-		 << "Name=\"CauchyStress\" format=\"ascii\">"
-		 << "\n";
-	for (Node *&n : nodes_)
-	{
-		double *cauchyStress = n->getCauchyStress();
-		for (int i = 0; i < dimension_ * (dimension_ + 1) / 2; i++)
-			file << cauchyStress[i] << " ";
-		file << "\n";
-	}
-	file << "      </DataArray> "
-		 << "\n";
-	if (mixed)
-	{
-		file << "      <DataArray type=\"Float64\" NumberOfComponents=\"" << 1 << "\" "
-			 << "Name=\"Pressure\" format=\"ascii\">"
-			 << "\n";
-		for (Node *&n : nodes_)
+		const std::string fileName = "results/" + text.str() + ".vtu";
+		auto write = [snapshot, fileName]()
 		{
-			file << n->getDegreeOfFreedom(dimension_)->getCurrentValue() << "\n";
-		}
-		file << "      </DataArray> "
-			 << "\n";
+			snapshot->write(fileName);
+		};
+		queueOutput(write);
+		return;
 	}
-	file << "      <DataArray type=\"Float64\" NumberOfComponents=\"" << 1 << "\" "
-		 << "Name=\"PermutedIndex\" format=\"ascii\">"
-		 << "\n";
-	for (Node *&node : nodes_)
+
+	std::vector<std::string> pieces(size);
+	for (int r = 0; r < size; r++)
+		pieces[r] = text.str() + "_" + std::to_string(r) + ".vtu";
+	const std::string indexName = (rank == 0) ? "results/" + text.str() + ".pvtu" : std::string();
+	auto write = [snapshot, pieces, rank, indexName]()
 	{
-		file << node->getPermutedIndex() << "\n";
-	}
-	file << "      </DataArray> "
-		 << "\n";
-	file << "    </PointData>"
-		 << "\n";
+		snapshot->write("results/" + pieces[rank]);
+		if (!indexName.empty())
+			snapshot->writeParallelIndex(indexName, pieces);
+	};
+	queueOutput(write);
+}
 
-	// elemental results
-	file << "    <CellData>"
-		 << "\n";
-	file << "      <DataArray type=\"Float64\" NumberOfComponents=\"" << 1 << "\" "
-		 << "Name=\"Rank\" format=\"ascii\">"
-		 << "\n";
-	for (Element *const &el : elements_)
+void SolidDomain::queueOutput(std::function<void()> task)
+{
+	if (!parameters_->useAsynchronousOutput())
 	{
-		file << el->getRank() << "\n";
+		task();
+		return;
 	}
-	file << "      </DataArray> "
-		 << "\n";
-	file << "    </CellData>"
-		 << "\n";
+	if (!outputQueue_)
+		outputQueue_ = new OutputQueue(parameters_->getOutputSnapshots());
+	outputQueue_->push(std::move(task));
+}
 
-	// footnote
-	file << "  </Piece>"
-		 << "\n"
-		 << "  </UnstructuredGrid>"
-		 << "\n"
-		 << "</VTKFile>"
-		 << "\n";
-	file.close();
+void SolidDomain::flushOutput()
+{
+	// Every result is on disk when the solve returns
+	writeTimeSeries();
+	if (!outputQueue_)
+		return;
+	auto start_timer = std::chrono::high_resolution_clock::now();
+	outputQueue_->flush();
+	auto end_timer = std::chrono::high_resolution_clock::now();
+	double flushTime = std::chrono::duration_cast<std::chrono::duration<double>>(end_timer - start_timer).count();
+	PetscPrintf(PETSC_COMM_WORLD, "Asynchronous output: %d outputs written in background, %f s waiting on a full queue, %f s on the final flush\n",
+				outputQueue_->getNumberOfTasks(), outputQueue_->getWaitingTime(), flushTime);
 }
 
 void SolidDomain::readInput(const std::string &inputFile, const bool &deleteFiles, const PartitionOfUnity elementType)
@@ -1358,7 +2998,7 @@ void SolidDomain::readInput(const std::string &inputFile, const bool &deleteFile
 		{
 			double coord;
 			std::istringstream(tokens[j + 1]) >> coord;
-			degreesOfFreedom.emplace_back(new DegreeOfFreedom(DOFType::POSITION, coord));
+			degreesOfFreedom.emplace_back(new DegreeOfFreedom(&dofStore_, DOFType::POSITION, coord));
 			numberOfDOFs_++;
 		}
 		nodes_.emplace_back(new Node(i, degreesOfFreedom));
@@ -1370,7 +3010,7 @@ void SolidDomain::readInput(const std::string &inputFile, const bool &deleteFile
 	if (mixed)
 		for (Node *&node : nodes_)
 		{
-			DegreeOfFreedom *dof = new DegreeOfFreedom(DOFType::PRESSURE, 0.0);
+			DegreeOfFreedom *dof = new DegreeOfFreedom(&dofStore_, DOFType::PRESSURE, 0.0);
 			node->addDegreeOfFreedom(dof);
 			numberOfDOFs_++;
 		}
@@ -2325,7 +3965,127 @@ void SolidDomain::elementalNeighborSearch() const
 	std::chrono::duration<double> elapsed = end_timer - start_timer;
 }
 
-void SolidDomain::createSystemMatrix(Mat &mat)
+void SolidDomain::elementColoring()
+{
+	// Greedy coloring of the elements owned by this rank: two elements that share a node never receive the same color.
+	// The node->element adjacency built by nodalNeighborSearch is used to find the conflicting elements.
+	int rank;
+	MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
+
+	elementColors_.clear();
+
+	std::unordered_map<Element *, int> elementColor;
+	elementColor.reserve(elements_.size());
+	std::vector<Element *> forbidden; // forbidden[c] is the last element that could not take color c
+
+	const unsigned int numberOfElements = elements_.size();
+	for (unsigned int e = 0; e < numberOfElements; e++)
+	{
+		Element *el = elements_[e];
+		if (el->getRank() != rank)
+			continue;
+
+		for (Node *const &node : el->getNodes())
+		{
+			for (Element *const &neighbor : node->getNeighborElements())
+			{
+				auto it = elementColor.find(neighbor);
+				if (it != elementColor.end())
+					forbidden[it->second] = el;
+			}
+		}
+
+		int color = 0;
+		while (color < forbidden.size() && forbidden[color] == el)
+			color++;
+		if (color == forbidden.size())
+		{
+			forbidden.push_back(nullptr);
+			elementColors_.emplace_back();
+		}
+
+		elementColor[el] = color;
+		elementColors_[color].push_back(e);
+	}
+
+	// Inside each color, compatible plane elements are placed next to each other and grouped in batches of up to
+	// PlaneElement::batchWidth elements; every other element forms a batch of its own
+	const int batchWidth = PlaneElement::batchWidth;
+	colorBatches_.assign(elementColors_.size(), std::vector<int>(1, 0));
+	for (unsigned int c = 0; c < elementColors_.size(); c++)
+	{
+		std::vector<int> &color = elementColors_[c];
+		std::vector<int> &batches = colorBatches_[c];
+
+		auto batchable = [this](const int &e) -> const PlaneElement *
+		{
+			const PlaneElement *plane = dynamic_cast<const PlaneElement *>(elements_[e]);
+			return (plane && plane->isBatchable()) ? plane : nullptr;
+		};
+		if (batchWidth > 1)
+			std::stable_sort(color.begin(), color.end(), [&](const int &e1, const int &e2)
+							 {
+								 const PlaneElement *p1 = batchable(e1), *p2 = batchable(e2);
+								 if (!p1 || !p2)
+									 return p1 && !p2;
+								 if (p1->getMaterial() != p2->getMaterial())
+									 return p1->getMaterial() < p2->getMaterial();
+								 if (p1->getParametricElement()->getElementType() != p2->getParametricElement()->getElementType())
+									 return p1->getParametricElement()->getElementType() < p2->getParametricElement()->getElementType();
+								 return p1->getNumberOfDOFs() < p2->getNumberOfDOFs(); });
+
+		const int colorSize = color.size();
+		const PlaneElement *first = nullptr;
+		for (int k = 0; k < colorSize; k++)
+		{
+			const PlaneElement *plane = (batchWidth > 1) ? batchable(color[k]) : nullptr;
+			const int size = k - batches.back();
+			if (k > 0 && (!plane || !first || size == batchWidth || !first->isBatchCompatible(*plane)))
+				batches.push_back(k);
+			if (k == batches.back())
+				first = plane;
+		}
+		batches.push_back(colorSize);
+	}
+}
+
+void SolidDomain::buildReferenceGeometryCache(const ReferenceConfiguration &reference)
+{
+	// The reference geometry only stays constant along the analysis for the total Lagrangian formulation, so it is
+	// cached just when the reference is the initial configuration. Any other reference (or a new mesh) drops the cache.
+	referenceGeometry_.clear();
+	for (Element *&el : elements_)
+		el->setReferenceGeometry(nullptr);
+
+	if (!parameters_->useReferenceGeometryCache() || reference != ReferenceConfiguration::INITIAL)
+		return;
+
+	int rank;
+	MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
+
+	const unsigned int numberOfElements = elements_.size();
+	std::vector<size_t> offsets(numberOfElements + 1, 0);
+	for (unsigned int e = 0; e < numberOfElements; e++)
+		offsets[e + 1] = offsets[e] + ((elements_[e]->getRank() == rank) ? elements_[e]->getReferenceGeometrySize() : 0);
+	referenceGeometry_.resize(offsets[numberOfElements]);
+
+#pragma omp parallel for num_threads(parameters_->getNumberOfThreads())
+	for (unsigned int e = 0; e < numberOfElements; e++)
+	{
+		if (offsets[e + 1] == offsets[e])
+			continue;
+		elements_[e]->computeReferenceGeometry(&referenceGeometry_[offsets[e]]);
+		elements_[e]->setReferenceGeometry(&referenceGeometry_[offsets[e]]);
+	}
+
+	double sizes[2]; // total and largest rank
+	sizes[0] = sizes[1] = referenceGeometry_.size() * sizeof(double) / 1048576.0;
+	MPI_Reduce((rank == 0) ? MPI_IN_PLACE : &sizes[0], &sizes[0], 1, MPI_DOUBLE, MPI_SUM, 0, PETSC_COMM_WORLD);
+	MPI_Reduce((rank == 0) ? MPI_IN_PLACE : &sizes[1], &sizes[1], 1, MPI_DOUBLE, MPI_MAX, 0, PETSC_COMM_WORLD);
+	PetscPrintf(PETSC_COMM_WORLD, "Reference geometry cache: %.2f MB in total, %.2f MB on the largest rank\n", sizes[0], sizes[1]);
+}
+
+void SolidDomain::buildSystemPattern()
 {
 	auto start_timer = std::chrono::high_resolution_clock::now();
 
@@ -2337,104 +4097,139 @@ void SolidDomain::createSystemMatrix(Mat &mat)
 	int N = numberOfBlockedDOFs_;
 	int nb = numberOfBlockedNodes_;
 
-	// defining the ownership range of each processor
-	int start[size], end[size], n = PETSC_DECIDE;
+	// defining the ownership range of this processor
+	int end, n = PETSC_DECIDE;
 	PetscSplitOwnership(PETSC_COMM_WORLD, &n, &N);
-	MPI_Scan(&n, &end[rank], 1, MPI_INT, MPI_SUM, PETSC_COMM_WORLD);
-	start[rank] = end[rank] - n;
-
-	for (int i = 0; i < size; i++)
+	MPI_Scan(&n, &end, 1, MPI_INT, MPI_SUM, PETSC_COMM_WORLD);
+	firstOwnedRow_ = end - n;
+	numberOfOwnedRows_ = n;
+
+	// Exact CSR pattern of the owned rows, with the columns of each row sorted.
+	// The dofs are numbered consecutively following the permuted order of the nodes, so the nodes holding the
+	// owned rows form a contiguous range of perm_ which is located by bisection: only the local rows are visited.
+	auto lastIndex = [this](const idx_t &k) { return nodes_[k]->getDegreesOfFreedom().back()->getIndex(); };
+	unsigned int firstNode = std::partition_point(perm_, perm_ + nb, [&](const idx_t &k)
+												  { return lastIndex(k) < firstOwnedRow_; }) -
+							 perm_;
+
+	rowPointer_.assign(1, 0);
+	rowPointer_.reserve(n + 1);
+	columnIndexes_.clear();
+	localDOFs_.clear();
+	localDOFs_.reserve(n);
+
+	std::vector<int> rowColumns;
+	for (unsigned int k = firstNode; k < nb; k++)
 	{
-		MPI_Bcast(&start[i], 1, MPI_INT, i, PETSC_COMM_WORLD);
-		MPI_Bcast(&end[i], 1, MPI_INT, i, PETSC_COMM_WORLD);
+		Node *&node = nodes_[perm_[k]];
+		const std::vector<Node *> &neighborNodes = node->getNeighborNodes();
+		const std::vector<DegreeOfFreedom *> &i_dofs = node->getDegreesOfFreedom();
+		if (i_dofs.front()->getIndex() >= end)
+			break;
+		for (DegreeOfFreedom *const &i_dof : i_dofs)
+		{
+			int i = i_dof->getIndex();
+			if (i < firstOwnedRow_ || i >= end)
+				continue;
+
+			rowColumns.clear();
+			for (auto &neighborNode : neighborNodes)
+				for (DegreeOfFreedom *const &j_dof : neighborNode->getDegreesOfFreedom())
+					rowColumns.push_back(j_dof->getIndex());
+			std::sort(rowColumns.begin(), rowColumns.end());
+
+			columnIndexes_.insert(columnIndexes_.end(), rowColumns.begin(), rowColumns.end());
+			rowPointer_.push_back(columnIndexes_.size());
+			localDOFs_.push_back(i_dof);
+		}
 	}
+	tangentValues_.assign(columnIndexes_.size(), 0.0);
 
-	// Number of nonzero entries in diagonal and off diagonal parts of the matrix
-	int *d_nnz_all = new int[N];
-	int *o_nnz_all = new int[N];
-
-	if (rank == 0)
+	// Ghost dofs: the ones of local elements owned by other ranks, in crescent order of index
+	std::vector<DegreeOfFreedom *> ghostDOFs;
+	for (Element *const &el : elements_)
 	{
-		// Counting the number of nonzeroes in the global matrix
-		int nnz = 0;
-		for (Node *&node : nodes_)
+		if (el->getRank() != rank)
+			continue;
+		for (DegreeOfFreedom *const &dof : el->getDegreesOfFreedom())
 		{
-			if (!node->isIsolated())
-			{
-				int ndof = node->getNumberOfDegreesOfFreedom();
-				const std::vector<Node *> &neighborNodes = node->getNeighborNodes();
-				for (auto &neighborNode : neighborNodes)
-				{
-					nnz += ndof * neighborNode->getNumberOfDegreesOfFreedom();
-				}
-			}
+			int index = dof->getIndex();
+			if ((index < firstOwnedRow_ || index >= end) && index < N)
+				ghostDOFs.push_back(dof);
 		}
+	}
+	std::sort(ghostDOFs.begin(), ghostDOFs.end(), [](DegreeOfFreedom *const &a, DegreeOfFreedom *const &b)
+			  { return a->getIndex() < b->getIndex(); });
+	ghostDOFs.erase(std::unique(ghostDOFs.begin(), ghostDOFs.end()), ghostDOFs.end());
+
+	ghostIndexes_.resize(ghostDOFs.size());
+	for (unsigned int i = 0; i < ghostDOFs.size(); i++)
+		ghostIndexes_[i] = ghostDOFs[i]->getIndex();
+	localDOFs_.insert(localDOFs_.end(), ghostDOFs.begin(), ghostDOFs.end());
+
+	// Position of every entry of the local element matrices in the CSR value array (-1 for rows owned by other ranks)
+	const unsigned int numberOfElements = elements_.size();
+	elementSlotOffsets_.assign(numberOfElements + 1, 0);
+	for (unsigned int e = 0; e < numberOfElements; e++)
+	{
+		Element *el = elements_[e];
+		int ndofs = (el->getRank() == rank) ? el->getNumberOfDOFs() : 0;
+		elementSlotOffsets_[e + 1] = elementSlotOffsets_[e] + ndofs * ndofs;
+	}
+	elementSlots_.assign(elementSlotOffsets_[numberOfElements], -1);
 
-		int *col = new int[nnz];   // stores the number of the column of each nonzero term
-		int *ptr = new int[N + 1]; // accumulates the number of nonzeroes per row in a CSR format
-		ptr[0] = 0;
-
-		// Iterating over the nodes in the permuted order. This block of code needs to acces the dofs in a crescent and consecutive order
-		// As only the dofs of blocked nodes are contributing to the matrix, we access only the firsts nblocked nodes
-		int sum = -1;
-		for (unsigned int k = 0; k < nb; k++)
+	for (unsigned int e = 0; e < numberOfElements; e++)
+	{
+		if (elementSlotOffsets_[e + 1] == elementSlotOffsets_[e])
+			continue; // element owned by another rank
+
+		Element *el = elements_[e];
+		const std::vector<DegreeOfFreedom *> &dofs = el->getDegreesOfFreedom();
+		const int ndofs = dofs.size();
+		int *slots = &elementSlots_[elementSlotOffsets_[e]];
+		for (int i = 0; i < ndofs; i++)
 		{
-			Node *&node = nodes_[perm_[k]];
-			const std::vector<DegreeOfFreedom *> &i_dofs = node->getDegreesOfFreedom();
-			for (DegreeOfFreedom *const &i_dof : i_dofs)
-			{
-				int i = i_dof->getIndex();
-				const std::vector<Node *> &neighborNodes = node->getNeighborNodes();
-				for (auto &neighborNode : neighborNodes)
-				{
-					const std::vector<DegreeOfFreedom *> &j_dofs = neighborNode->getDegreesOfFreedom();
-					for (DegreeOfFreedom *const &j_dof : j_dofs)
-					{
-						int j = j_dof->getIndex();
-						col[++sum] = j;
-					}
-				}
-				ptr[i + 1] = sum + 1;
-			}
-		}
+			int row = dofs[i]->getIndex() - firstOwnedRow_;
+			if (row < 0 || row >= n)
+				continue;
 
-		// number of non-zeros by row
-		for (int k = 0; k < size; k++)
-		{
-			int low = start[k];
-			int high = end[k];
-			for (int i = low; i < high; i++)
+			const int *rowBegin = &columnIndexes_[rowPointer_[row]];
+			const int *rowEnd = &columnIndexes_[rowPointer_[row + 1]];
+			for (int j = 0; j < ndofs; j++)
 			{
-				int inf = ptr[i];
-				int sup = ptr[i + 1];
-				d_nnz_all[i] = 0;
-				o_nnz_all[i] = 0;
-				for (int j = inf; j < sup; j++)
-				{
-					if (col[j] >= low && col[j] < high)
-						++d_nnz_all[i];
-					else
-						++o_nnz_all[i];
-				}
+				const int *position = std::lower_bound(rowBegin, rowEnd, dofs[j]->getIndex());
+				slots[ndofs * i + j] = position - &columnIndexes_[0];
 			}
 		}
-		delete[] ptr;
-		delete[] col;
 	}
 
-	MPI_Bcast(d_nnz_all, N, MPI_INT, 0, PETSC_COMM_WORLD);
-	MPI_Bcast(o_nnz_all, N, MPI_INT, 0, PETSC_COMM_WORLD);
+	systemPatternOutdated_ = false;
+
+	auto end_timer = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<double> elapsed = end_timer - start_timer;
+
+	// PetscPrintf(PETSC_COMM_WORLD, "Building the sparsity pattern. Elapsed time: %f\n", elapsed.count());
+}
 
-	int *d_nnz = &d_nnz_all[start[rank]];
-	int *o_nnz = &o_nnz_all[start[rank]];
+void SolidDomain::createSystemMatrix(Mat &mat)
+{
+	auto start_timer = std::chrono::high_resolution_clock::now();
 
-	// Create PETSc sparse matrix
-	MatCreateAIJ(PETSC_COMM_WORLD, n, n, N, N, 0, d_nnz, 0, o_nnz, &mat);
+	// The pattern is only rebuilt when the mesh topology has changed (or after a matrix-free solve released it)
+	if (systemPatternOutdated_ || (int)rowPointer_.size() != numberOfOwnedRows_ + 1)
+		buildSystemPattern();
 
-	delete[] d_nnz_all;
-	delete[] o_nnz_all;
+	int N = numberOfBlockedDOFs_;
+	int n = numberOfOwnedRows_;
 
+	// Create PETSc sparse matrix preallocated with the exact CSR pattern
+	MatCreate(PETSC_COMM_WORLD, &mat);
+	MatSetSizes(mat, n, n, N, N);
+	MatSetType(mat, MATAIJ);
 	MatSetFromOptions(mat);
+	MatSeqAIJSetPreallocationCSR(mat, rowPointer_.data(), columnIndexes_.data(), nullptr);
+	MatMPIAIJSetPreallocationCSR(mat, rowPointer_.data(), columnIndexes_.data(), nullptr);
+	MatSetOption(mat, MAT_NEW_NONZERO_ALLOCATION_ERR, PETSC_TRUE);
 
 	auto end_timer = std::chrono::high_resolution_clock::now();
 	std::chrono::duration<double> elapsed = end_timer - start_timer;
@@ -2442,6 +4237,17 @@ void SolidDomain::createSystemMatrix(Mat &mat)
 	// PetscPrintf(PETSC_COMM_WORLD, "Allocating memory for the sparse matrix. Elapsed time: %f\n", elapsed.count());
 }
 
+void SolidDomain::createSystemVectors(Vec &rhs, Vec &solution)
+{
+	if (systemPatternOutdated_)
+		buildSystemPattern();
+
+	// The solution carries the ghost dofs needed by the local elements, so the update touches only local data
+	VecCreateGhost(PETSC_COMM_WORLD, numberOfOwnedRows_, numberOfBlockedDOFs_, ghostIndexes_.size(), ghostIndexes_.data(), &solution);
+	VecSetFromOptions(solution);
+	VecDuplicate(solution, &rhs);
+}
+
 void SolidDomain::reorderDOFs()
 {
 	// getting processor rank and total number of processors
@@ -2526,18 +4332,37 @@ void SolidDomain::reorderDOFs()
 
 	// Setting the new index for nodes and their DOFs
 	int dof_index = -1;
+	std::vector<DegreeOfFreedom *> orderedDOFs;
+	orderedDOFs.reserve(numberOfDOFs_);
 	for (int i = 0; i < n; i++) // i is the new index of node perm[i]
 	{
 		int initial_index = perm_[i];
 		Node *node = nodes_[initial_index];
 		node->setPermutedIndex(i);
-		std::vector<DegreeOfFreedom *> dofs = node->getDegreesOfFreedom();
-		for (DegreeOfFreedom *&dof : dofs)
+		const std::vector<DegreeOfFreedom *> &dofs = node->getDegreesOfFreedom();
+		for (DegreeOfFreedom *const &dof : dofs)
 		{
 			dof->setIndex(++dof_index);
+			orderedDOFs.push_back(dof);
 		}
 	}
 
+	// The state of the dofs is stored contiguously in index order (slot == index)
+	dofStore_.rebuild(orderedDOFs);
+	PetscPrintf(PETSC_COMM_WORLD, "DOF state store: %d DOFs, %.0f bytes per DOF\n", dofStore_.getSize(), dofStore_.getBytesPerDOF());
+
+	// Position and pressure splits of the blocked dofs
+	const DOFType *types = dofStore_.getTypes();
+	positionIndexes_.clear();
+	pressureIndexes_.clear();
+	for (int i = 0; i < numberOfBlockedDOFs_; i++)
+	{
+		if (types[i] == DOFType::PRESSURE)
+			pressureIndexes_.push_back(i);
+		else
+			positionIndexes_.push_back(i);
+	}
+
 	auto end_timer = std::chrono::high_resolution_clock::now();
 	std::chrono::duration<double> elapsed = end_timer - start_timer;
 
@@ -2570,11 +4395,8 @@ void SolidDomain::domainDecomposition()
 	MPI_Scan(&n, &end[rank], 1, MPI_INT, MPI_SUM, PETSC_COMM_WORLD);
 	start[rank] = end[rank] - n;
 
-	for (int i = 0; i < size; i++)
-	{
-		MPI_Bcast(&start[i], 1, MPI_INT, i, PETSC_COMM_WORLD);
-		MPI_Bcast(&end[i], 1, MPI_INT, i, PETSC_COMM_WORLD);
-	}
+	MPI_Allgather(MPI_IN_PLACE, 1, MPI_INT, start, 1, MPI_INT, PETSC_COMM_WORLD);
+	MPI_Allgather(MPI_IN_PLACE, 1, MPI_INT, end, 1, MPI_INT, PETSC_COMM_WORLD);
 
 	if (rank == 0)
 	{
@@ -2621,11 +4443,8 @@ void SolidDomain::domainDecomposition()
 		MPI_Scan(&n, &end[rank], 1, MPI_INT, MPI_SUM, PETSC_COMM_WORLD);
 		start[rank] = end[rank] - n;
 
-		for (int i = 0; i < size; i++)
-		{
-			MPI_Bcast(&start[i], 1, MPI_INT, i, PETSC_COMM_WORLD);
-			MPI_Bcast(&end[i], 1, MPI_INT, i, PETSC_COMM_WORLD);
-		}
+		MPI_Allgather(MPI_IN_PLACE, 1, MPI_INT, start, 1, MPI_INT, PETSC_COMM_WORLD);
+		MPI_Allgather(MPI_IN_PLACE, 1, MPI_INT, end, 1, MPI_INT, PETSC_COMM_WORLD);
 	}
 
 	if (rank == 0)
@@ -2672,14 +4491,20 @@ void SolidDomain::solveStaticProblem()
 {
 	auto start_timer = std::chrono::high_resolution_clock::now();
 
+	assemblyTime_ = 0.0;
 	setReferenceConfiguration(ReferenceConfiguration::INITIAL);
 	parameters_->setStaticAnalysis(true);
 
+	if (parameters_->useArcLength())
+	{
+		solveArcLengthProblem();
+		return;
+	}
+
 	// Petsc variables
 	Mat tangent;
 	Vec rhs, solution;
 	KSP ksp;
-	PC pc;
 	PetscLogDouble bytes = 0.0;
 	PetscBool isbjacobi;
 
@@ -2703,31 +4528,84 @@ void SolidDomain::solveStaticProblem()
 	double *externalForces;
 	getExternalForces(ndofsForces, dofsForces, externalForces);
 
-	KSPCreate(PETSC_COMM_WORLD, &ksp);
-	KSPSetType(ksp, KSPFGMRES);
-	KSPSetTolerances(ksp, 1.0e-8, PETSC_DEFAULT, PETSC_DEFAULT, 100);
-	KSPGMRESSetRestart(ksp, 100);
-	KSPGetPC(ksp, &pc);
-	PCSetType(pc, PCBJACOBI);
-
 	createSystemMatrix(tangent);
 
 	// Create PETSc vectors
-	VecCreate(PETSC_COMM_WORLD, &rhs);
-	VecSetSizes(rhs, PETSC_DECIDE, numberOfBlockedDOFs_);
-	VecSetFromOptions(rhs);
-	VecDuplicate(rhs, &solution);
+	createSystemVectors(rhs, solution);
+
+	KSPCreate(PETSC_COMM_WORLD, &ksp);
+	configureLinearSolver(ksp, SolverProfile::FGMRES_BJACOBI);
+
+	// Globalization of the Newton step: the residual alone is evaluated at the trial step lengths
+	const Globalization globalization = parameters_->getGlobalization();
+	Vec residual, increment;
+	double trustRadius = 0.0;
+	double loadFactor = 0.0;
+	std::vector<double> constrainedZeros(numberOfConstrainedDOFs, 0.0);
+	auto refreshVariables = [this]()
+	{
+		setPastVariables();
+		computeIntermediateVariables();
+	};
+	auto computeResidual = [&](Vec &vec)
+	{
+		VecZeroEntries(vec);
+		applyNeummanConditions(vec, tangent, ndofsForces, dofsForces, externalForces, loadFactor);
+		assembleResidual(vec);
+		VecSetValues(vec, numberOfConstrainedDOFs, constrainedDOFs, constrainedZeros.data(), INSERT_VALUES);
+		VecAssemblyBegin(vec);
+		VecAssemblyEnd(vec);
+	};
+
+	// The line search on the total potential energy needs one: Saint Venant-Kirchhoff solids, whose energy getEnergy
+	// computes exactly, conservative loads and no pressure dofs. Otherwise the directional derivative is used.
+	bool energyLineSearch = globalization == Globalization::CRITICAL_POINT && pressureIndexes_.empty();
+	for (NeumannBoundaryCondition *const &nbc : neumannBoundaryConditions_)
+		if (nbc->getType() != CONSERVATIVE)
+			energyLineSearch = false;
+	for (Element *const &el : elements_)
+	{
+		const ElasticSolid *solid = dynamic_cast<const ElasticSolid *>(el->getMaterial());
+		if (!solid || solid->getConstitutiveModel() != SAINT_VENANT_KIRCHHOFF)
+			energyLineSearch = false;
+	}
+	auto computeEnergy = [&]()
+	{
+		double energy = 0.0;
+		for (Element *const &el : elements_)
+		{
+			if (el->getRank() != rank || !el->isActive())
+				continue;
+			double strainEnergy, kinectEnergy, domainForcePotentialEnergy;
+			el->getEnergy(strainEnergy, kinectEnergy, domainForcePotentialEnergy);
+			energy += strainEnergy - domainForcePotentialEnergy;
+		}
+		for (int i = 0; i < ndofsForces; i++)
+		{
+			const int index = dofsForces[i]->getIndex();
+			if (index >= firstOwnedRow_ && index < firstOwnedRow_ + numberOfOwnedRows_)
+				energy -= loadFactor * externalForces[i] * dofsForces[i]->getCurrentValue();
+		}
+		MPI_Allreduce(MPI_IN_PLACE, &energy, 1, MPI_DOUBLE, MPI_SUM, PETSC_COMM_WORLD);
+		return energy;
+	};
+	if (globalization != Globalization::FULL_STEP)
+	{
+		VecDuplicate(rhs, &residual);
+		VecDuplicate(solution, &increment);
+	}
 
 	const int numberOfSteps = parameters_->getNumberOfSteps();
 	const int maxNonlinearIterations = parameters_->getMaxNonlinearIterations();
 	const double nonlinearTolerance = parameters_->getNonlinearTolerance();
+	const bool residualCriterion = parameters_->getConvergenceCriterion() != ConvergenceCriterion::POSITION_INCREMENT;
+	double referenceResidual = 0.0, referenceEnergy = 0.0;
 
-	if (rank == 0)
-		exportToParaview(0);
+	exportToParaview(0);
 
 	for (int step = 0; step < numberOfSteps; step++)
 	{
-		double loadFactor = ((double)step + 1.0) / (double)numberOfSteps;
+		loadFactor = ((double)step + 1.0) / (double)numberOfSteps;
 
 		PetscPrintf(PETSC_COMM_WORLD, "\n----------------------- STEP = %d, Loadfactor = %f  -----------------------\n\n", step + 1, loadFactor);
 		parameters_->setCurrentTime(loadFactor);
@@ -2737,6 +4615,7 @@ void SolidDomain::solveStaticProblem()
 			modelVolume += el->getBaseElement()->getJacobianIntegration();
 		}
 		parameters_->setModelVolume(modelVolume);
+		attachNearNullSpace(tangent, ksp);
 
 		double positionNorm, pressureNorm;
 		for (int iteration = 0; iteration < maxNonlinearIterations; iteration++)
@@ -2747,10 +4626,30 @@ void SolidDomain::solveStaticProblem()
 			assembleStaticLinearSystem(tangent, rhs);
 			MatZeroRowsColumns(tangent, numberOfConstrainedDOFs, constrainedDOFs, 1.0, solution, rhs);
 			MatView(tangent, PETSC_VIEWER_DRAW_WORLD);
+			if (residualCriterion && checkResidualConvergence(rhs, solution, iteration, referenceResidual, referenceEnergy))
+			{
+				MatZeroEntries(tangent);
+				VecZeroEntries(rhs);
+				break;
+			}
 			solveLinearSystem(ksp, tangent, rhs, solution);
 			updateVariables(solution, positionNorm, pressureNorm);
 			setPastVariables();
 			computeIntermediateVariables();
+			if (globalization != Globalization::FULL_STEP)
+			{
+				// The accepted increment is the Newton step scaled by the globalization
+				const double alpha = globalizeNewtonStep(rhs, solution, residual, increment, computeResidual, refreshVariables, trustRadius,
+														 energyLineSearch ? computeEnergy : std::function<double()>());
+				VecScale(solution, alpha);
+				positionNorm *= alpha;
+				pressureNorm *= alpha;
+			}
+			if (residualCriterion && iteration == 0)
+			{
+				VecDot(solution, rhs, &referenceEnergy);
+				referenceEnergy = std::fabs(referenceEnergy);
+			}
 
 			PetscMemoryGetCurrentUsage(&bytes);
 			PetscPrintf(PETSC_COMM_WORLD, "Newton iteration: %d - L2 Position Norm: %E - L2 Pressure Norm: %E\nMemory used by each processor: %f Mb\n",
@@ -2759,28 +4658,32 @@ void SolidDomain::solveStaticProblem()
 			MatZeroEntries(tangent);
 			VecZeroEntries(rhs);
 
-			if (positionNorm / initialPositionNorm <= nonlinearTolerance)
+			if (!residualCriterion && positionNorm / initialPositionNorm <= nonlinearTolerance)
 				break;
 		}
 
 		// export results to paraview
-		if (rank == 0)
-		{
-			computeCauchyStress();
-			exportToParaview(step + 1);
-		}
+		computeCauchyStress();
+		exportToParaview(step + 1);
 	}
+	flushOutput();
 	delete[] constrainedDOFs;
 	delete[] externalForces;
 	MatDestroy(&tangent);
 	KSPDestroy(&ksp);
 	VecDestroy(&rhs);
 	VecDestroy(&solution);
+	if (globalization != Globalization::FULL_STEP)
+	{
+		VecDestroy(&residual);
+		VecDestroy(&increment);
+	}
 
 	auto end_timer = std::chrono::high_resolution_clock::now();
 	std::chrono::duration<double> elapsed = end_timer - start_timer;
 
 	PetscPrintf(PETSC_COMM_WORLD, "Solid Analysis Done. Elapsed time: %f\n", elapsed.count());
+	PetscPrintf(PETSC_COMM_WORLD, "Time spent assembling linear systems: %f\n", assemblyTime_);
 }
 
 void SolidDomain::applyInitialConditions()
@@ -2803,70 +4706,286 @@ void SolidDomain::applyInitialConditions()
 	}
 }
 
-void SolidDomain::assembleStaticLinearSystem(Mat &mat, Vec &vec)
+void SolidDomain::solveArcLengthProblem()
 {
+	/*	Arc-length continuation (Riks/Crisfield) of the static problem. The load factor scales the Neumann loads and
+		each step is constrained to |du|^2 + psi^2 dlambda^2 |q|^2 = dl^2 (psi = 0 cylindrical, psi = 1 spherical).
+		The corrector uses the bordering algorithm: K du_R = R and K du_q = q are solved with the same factorization.
+		The arc length follows the number of Newton iterations of the last step and is halved after failures. The step
+		crossing the full load is interpolated back to the load factor 1 and corrected there with the load fixed.
+	*/
 	auto start_timer = std::chrono::high_resolution_clock::now();
 
-	int rank, size;
+	// Petsc variables
+	Mat tangent;
+	Vec rhs, solution, loadVector, loadStep, correction, stepIncrement, previousIncrement;
+	KSP ksp;
+
+	int rank;
 	MPI_Comm_rank(PETSC_COMM_WORLD, &rank);
-	MPI_Comm_size(PETSC_COMM_WORLD, &size);
 
+	double initialPositionNorm = getInitialPositionNorm();
+
+	int numberOfConstrainedDOFs;
+	int *constrainedDOFs;
+	getConstrainedDOFs(numberOfConstrainedDOFs, constrainedDOFs);
+	std::vector<double> constrainedZeros(numberOfConstrainedDOFs, 0.0);
+
+	int ndofsForces;
+	std::vector<DegreeOfFreedom *> dofsForces;
+	double *externalForces;
+	getExternalForces(ndofsForces, dofsForces, externalForces);
+
+	createSystemMatrix(tangent);
+	createSystemVectors(rhs, solution);
+	VecDuplicate(rhs, &loadVector);
+	VecDuplicate(solution, &loadStep);
+	VecDuplicate(solution, &correction);
+	VecDuplicate(solution, &stepIncrement);
+	VecDuplicate(solution, &previousIncrement);
+	VecZeroEntries(previousIncrement);
+
+	KSPCreate(PETSC_COMM_WORLD, &ksp);
+	configureLinearSolver(ksp, SolverProfile::FGMRES_BJACOBI);
+
+	const int maxNonlinearIterations = parameters_->getMaxNonlinearIterations();
+	const double nonlinearTolerance = parameters_->getNonlinearTolerance();
+	const int desiredIterations = parameters_->getArcLengthIterations();
+	const double psi2 = parameters_->getArcLengthScaling() * parameters_->getArcLengthScaling();
+	const int maxSteps = parameters_->getMaxArcLengthSteps();
+
+	// Reference load vector: the Neumann loads at unit load factor
+	VecZeroEntries(loadVector);
+	applyNeummanConditions(loadVector, tangent, ndofsForces, dofsForces, externalForces, 1.0);
+	VecAssemblyBegin(loadVector);
+	VecAssemblyEnd(loadVector);
+	VecSetValues(loadVector, numberOfConstrainedDOFs, constrainedDOFs, constrainedZeros.data(), INSERT_VALUES);
+	VecAssemblyBegin(loadVector);
+	VecAssemblyEnd(loadVector);
+	double qq;
+	VecDot(loadVector, loadVector, &qq);
+	if (qq == 0.0)
+	{
+		PetscPrintf(PETSC_COMM_WORLD, "Arc-length continuation needs Neumann loads to scale, the problem has none.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Applies a multiple of a ghosted increment to the state
+	auto applyIncrement = [&](Vec &vec, const double &factor)
+	{
+		double positionNorm, pressureNorm;
+		if (factor != 1.0)
+			VecScale(vec, factor);
+		updateVariables(vec, positionNorm, pressureNorm);
+		if (factor != 1.0)
+			VecScale(vec, 1.0 / factor);
+		setPastVariables();
+		computeIntermediateVariables();
+	};
+
+	// Tangent at the current state, with the Dirichlet rows and columns replaced by the identity
+	auto assembleTangent = [&](const double &loadFactor)
+	{
+		parameters_->setCurrentTime(loadFactor);
+		VecZeroEntries(rhs);
+		MatZeroEntries(tangent);
+		applyNeummanConditions(rhs, tangent, ndofsForces, dofsForces, externalForces, loadFactor);
+		assembleStaticLinearSystem(tangent, rhs);
+		MatZeroRowsColumns(tangent, numberOfConstrainedDOFs, constrainedDOFs, 1.0, nullptr, nullptr);
+		VecSetValues(rhs, numberOfConstrainedDOFs, constrainedDOFs, constrainedZeros.data(), INSERT_VALUES);
+		VecAssemblyBegin(rhs);
+		VecAssemblyEnd(rhs);
+	};
+
+	double modelVolume = 0.0;
 	for (Element *const &el : elements_)
+		modelVolume += el->getBaseElement()->getJacobianIntegration();
+	parameters_->setModelVolume(modelVolume);
+
+	setPastVariables();
+	computeIntermediateVariables();
+
+	exportGraphicData(0.0);
+	exportToParaview(0);
+
+	double loadFactor = 0.0;
+	double arcLength = parameters_->getInitialArcLength();
+	double minArcLength = 0.0;
+	int totalIterations = 0;
+	int step = 0;
+	while (loadFactor < 1.0 && step < maxSteps)
 	{
-		if (el->getRank() == rank && el->isActive())
+		// Predictor along the tangent, oriented as the previous step so that the path goes past limit points
+		assembleTangent(loadFactor);
+		solveLinearSystem(ksp, tangent, loadVector, loadStep);
+		double tt, previousDot;
+		VecDot(loadStep, loadStep, &tt);
+		VecDot(loadStep, previousIncrement, &previousDot);
+		if (arcLength <= 0.0)
+			arcLength = std::sqrt(tt + psi2 * qq) / (double)parameters_->getNumberOfSteps();
+		if (minArcLength <= 0.0)
+			minArcLength = 1.0e-6 * arcLength;
+
+		double stepLoad = ((previousDot < 0.0) ? -1.0 : 1.0) * arcLength / std::sqrt(tt + psi2 * qq);
+		VecCopy(loadStep, stepIncrement);
+		VecScale(stepIncrement, stepLoad);
+		applyIncrement(stepIncrement, 1.0);
+		loadFactor += stepLoad;
+
+		// Corrector
+		bool converged = false;
+		int iteration = 0;
+		for (; iteration < maxNonlinearIterations; iteration++)
 		{
-			int ndofsPosition, ndofsPressure;
-			int *indexes;
-			double *rhsValues, *hessianValues;
-			el->elementContributions(ndofsPosition, ndofsPressure, indexes, rhsValues, hessianValues);
-			int ndofs = ndofsPosition + ndofsPressure;
-			// dispersing element rhs contribution into global rhs vector
-			VecSetValues(vec, ndofs, indexes, rhsValues, ADD_VALUES);
+			assembleTangent(loadFactor);
+			solveLinearSystem(ksp, tangent, rhs, correction);
+			solveLinearSystem(ksp, tangent, loadVector, loadStep);
+
+			// Constraint on the updated step: a dl^2 + b dl + c = 0 for the load correction dl
+			double qt, rt, rr, st, sr, ss;
+			VecDot(loadStep, loadStep, &qt);
+			VecDot(correction, loadStep, &rt);
+			VecDot(correction, correction, &rr);
+			VecDot(stepIncrement, loadStep, &st);
+			VecDot(stepIncrement, correction, &sr);
+			VecDot(stepIncrement, stepIncrement, &ss);
+			const double a = qt + psi2 * qq;
+			const double b = 2.0 * (st + rt) + 2.0 * psi2 * stepLoad * qq;
+			const double c = ss + 2.0 * sr + rr + psi2 * stepLoad * stepLoad * qq - arcLength * arcLength;
+			const double discriminant = b * b - 4.0 * a * c;
+			if (discriminant < 0.0)
+				break;
 
-			// dispersing element matrices contribution into global tangent matrix
-			for (int i = 0; i < ndofsPosition; i++)
+			// The root keeping the step closest to its current direction
+			const double roots[2] = {(-b + std::sqrt(discriminant)) / (2.0 * a), (-b - std::sqrt(discriminant)) / (2.0 * a)};
+			double loadCorrection = roots[0];
+			double bestCosine = -1.0e300;
+			for (const double &root : roots)
 			{
-				for (int j = 0; j < ndofsPosition; j++)
-				{
-					double value = hessianValues[ndofs * i + j]; // value = 0.0;
-					MatSetValues(mat, 1, &indexes[i], 1, &indexes[j], &value, ADD_VALUES);
-				}
-				for (int j = 0; j < ndofsPressure; j++)
+				const double cosine = ss + sr + root * st + psi2 * stepLoad * (stepLoad + root) * qq;
+				if (cosine > bestCosine)
 				{
-					double value = hessianValues[ndofsPosition + ndofs * i + j]; // value = 0.0;
-					MatSetValues(mat, 1, &indexes[i], 1, &indexes[ndofsPosition + j], &value, ADD_VALUES);
+					bestCosine = cosine;
+					loadCorrection = root;
 				}
 			}
 
-			for (int i = 0; i < ndofsPressure; i++)
+			VecAXPY(correction, loadCorrection, loadStep);
+			applyIncrement(correction, 1.0);
+			VecAXPY(stepIncrement, 1.0, correction);
+			stepLoad += loadCorrection;
+			loadFactor += loadCorrection;
+
+			double correctionNorm;
+			VecNorm(correction, NORM_2, &correctionNorm);
+			PetscPrintf(PETSC_COMM_WORLD, "Arc-length iteration: %d - L2 Position Norm: %E - Load factor: %E\n",
+						iteration, correctionNorm / initialPositionNorm, loadFactor);
+			if (correctionNorm / initialPositionNorm <= nonlinearTolerance)
+			{
+				converged = true;
+				iteration++;
+				break;
+			}
+		}
+		totalIterations += iteration;
+
+		if (!converged)
+		{
+			// Back to the last converged state with a shorter arc
+			applyIncrement(stepIncrement, -1.0);
+			loadFactor -= stepLoad;
+			arcLength *= 0.5;
+			PetscPrintf(PETSC_COMM_WORLD, "Arc-length step did not converge, retrying with arc length %E\n", arcLength);
+			if (arcLength < minArcLength)
+			{
+				PetscPrintf(PETSC_COMM_WORLD, "Arc length below %E, stopping the continuation\n", minArcLength);
+				break;
+			}
+			continue;
+		}
+
+		if (loadFactor > 1.0)
+		{
+			// The arc went past full load: back along it to the load factor 1, then corrected at fixed load
+			const double previousLoadFactor = loadFactor - stepLoad;
+			const double fraction = (1.0 - previousLoadFactor) / stepLoad;
+			applyIncrement(stepIncrement, fraction - 1.0);
+			VecScale(stepIncrement, fraction);
+			stepLoad = 1.0 - previousLoadFactor;
+			loadFactor = 1.0;
+
+			converged = false;
+			for (iteration = 0; iteration < maxNonlinearIterations; iteration++)
 			{
-				for (int j = 0; j < ndofsPosition; j++)
+				assembleTangent(loadFactor);
+				solveLinearSystem(ksp, tangent, rhs, correction);
+				applyIncrement(correction, 1.0);
+				VecAXPY(stepIncrement, 1.0, correction);
+
+				double correctionNorm;
+				VecNorm(correction, NORM_2, &correctionNorm);
+				PetscPrintf(PETSC_COMM_WORLD, "Load-controlled iteration: %d - L2 Position Norm: %E - Load factor: %E\n",
+							iteration, correctionNorm / initialPositionNorm, loadFactor);
+				if (correctionNorm / initialPositionNorm <= nonlinearTolerance)
 				{
-					double value = hessianValues[ndofs * (ndofsPosition + i) + j]; // value = 0.0;
-					MatSetValues(mat, 1, &indexes[ndofsPosition + i], 1, &indexes[j], &value, ADD_VALUES);
+					converged = true;
+					iteration++;
+					break;
 				}
-				for (int j = 0; j < ndofsPressure; j++)
+			}
+			totalIterations += iteration;
+
+			if (!converged)
+			{
+				applyIncrement(stepIncrement, -1.0);
+				loadFactor = previousLoadFactor;
+				arcLength *= 0.5;
+				PetscPrintf(PETSC_COMM_WORLD, "Final step at full load did not converge, retrying with arc length %E\n", arcLength);
+				if (arcLength < minArcLength)
 				{
-					double value = hessianValues[ndofs * (ndofsPosition + i) + ndofsPosition + j]; // value = 0.0;
-					MatSetValues(mat, 1, &indexes[ndofsPosition + i], 1, &indexes[ndofsPosition + j], &value, ADD_VALUES);
+					PetscPrintf(PETSC_COMM_WORLD, "Arc length below %E, stopping the continuation\n", minArcLength);
+					break;
 				}
+				continue;
 			}
-			delete[] indexes;
-			delete[] rhsValues;
-			delete[] hessianValues;
 		}
+
+		step++;
+		VecCopy(stepIncrement, previousIncrement);
+		PetscPrintf(PETSC_COMM_WORLD, "\n----------------------- ARC-LENGTH STEP = %d, Loadfactor = %f, Arc length = %E, Iterations = %d -----------------------\n\n",
+					step, loadFactor, arcLength, iteration);
+		arcLength *= std::min(std::max(std::sqrt((double)desiredIterations / (double)iteration), 0.5), 2.0);
+
+		// The load-displacement path is appended to plotData as it is traced, whatever the buffering
+		computeCauchyStress();
+		exportGraphicData(loadFactor);
+		writeTimeSeries();
+		exportToParaview(step);
 	}
 
-	// Assemble matrices and vectors
-	MatAssemblyBegin(mat, MAT_FINAL_ASSEMBLY);
-	MatAssemblyEnd(mat, MAT_FINAL_ASSEMBLY);
-	VecAssemblyBegin(vec);
-	VecAssemblyEnd(vec);
+	flushOutput();
+	delete[] constrainedDOFs;
+	delete[] externalForces;
+	KSPDestroy(&ksp);
+	VecDestroy(&rhs);
+	VecDestroy(&solution);
+	VecDestroy(&loadVector);
+	VecDestroy(&loadStep);
+	VecDestroy(&correction);
+	VecDestroy(&stepIncrement);
+	VecDestroy(&previousIncrement);
+	MatDestroy(&tangent);
 
 	auto end_timer = std::chrono::high_resolution_clock::now();
 	std::chrono::duration<double> elapsed = end_timer - start_timer;
 
-	// PetscPrintf(PETSC_COMM_WORLD, "Assemble Linear System. Elapsed time: %f\n", elapsed.count());
+	PetscPrintf(PETSC_COMM_WORLD, "Arc-length Analysis Done. Steps: %d - Newton iterations: %d - Elapsed time: %f\n", step, totalIterations, elapsed.count());
+	PetscPrintf(PETSC_COMM_WORLD, "Time spent assembling linear systems: %f\n", assemblyTime_);
+}
+
+void SolidDomain::assembleStaticLinearSystem(Mat &mat, Vec &vec)
+{
+	assembleLinearSystem(mat, vec);
 }
 
 void SolidDomain::solveStaggeredProblem(int &ndofsInterfaceForces,
@@ -2877,7 +4996,6 @@ void SolidDomain::solveStaggeredProblem(int &ndofsInterfaceForces,
 	Mat tangent;
 	Vec rhs, solution;
 	KSP ksp;
-	PC pc;
 	PetscLogDouble bytes = 0.0;
 
 	int rank;
@@ -2903,16 +5021,10 @@ void SolidDomain::solveStaggeredProblem(int &ndofsInterfaceForces,
 	createSystemMatrix(tangent);
 
 	// Create PETSc vectors
-	VecCreate(PETSC_COMM_WORLD, &rhs);
-	VecSetSizes(rhs, PETSC_DECIDE, numberOfDOFs_);
-	VecSetFromOptions(rhs);
-	VecDuplicate(rhs, &solution);
+	createSystemVectors(rhs, solution);
 
 	KSPCreate(PETSC_COMM_WORLD, &ksp);
-	KSPSetType(ksp, KSPPREONLY);
-	KSPGetPC(ksp, &pc);
-	PCSetType(pc, PCLU);
-	PCFactorSetMatSolverType(pc, MATSOLVERMUMPS);
+	configureLinearSolver(ksp, SolverProfile::DIRECT_MUMPS);
 	KSPSetFromOptions(ksp);
 
 	const int maxNonlinearIterations = parameters_->getMaxNonlinearIterations();
@@ -2941,6 +5053,7 @@ void SolidDomain::solveStaggeredProblem(int &ndofsInterfaceForces,
 		if (positionNorm / initialPositionNorm <= nonlinearTolerance)
 			break;
 	}
+	gatherNodalVariables(true);
 
 	delete[] constrainedDOFs;
 	delete[] externalForces;
@@ -10,6 +10,10 @@
 #include "PlaneElement.h"
 #include "TriangularMesher.h"
 #include "OutputGraphic.h"
+#include "VTUWriter.h"
+#include "OutputQueue.h"
+#include "XDMFWriter.h"
+#include "TimeSeriesRecorder.h"
 #include <unordered_map>
 #include <petscksp.h>
 #include <metis.h>
@@ -51,8 +55,49 @@ public:
 
 	void setLumpedMass(const bool &useLumpedMass);
 
+	void setNumberOfThreads(const int &numberOfThreads);
+
 	void setReferenceConfiguration(const ReferenceConfiguration reference);
 
+	void setReferenceGeometryCache(const bool &useCache);
+
+	void setSolverProfile(const SolverProfile &profile);
+
+	// Experimental: the transient tangent is applied element by element instead of being stored. Every Krylov
+	// iteration re-evaluates the element tangents, so a product costs about as much as an assembly; it only pays
+	// off when the assembled tangent does not fit in memory.
+	void setMatrixFree(const bool &useMatrixFree);
+
+	void setArcLength(const bool &useArcLength, const double &initialArcLength = 0.0, const int &desiredIterations = 5,
+					  const double &loadScaling = 0.0, const int &maxSteps = 1000);
+
+	void setGlobalization(const Globalization &globalization, const int &maxLineSearchIterations = 10);
+
+	void setModifiedNewton(const bool &useModifiedNewton, const int &maxFactorizationReuses = 10, const double &refactorizationContraction = 0.5);
+
+	void setExplicitCourantNumber(const double &courantNumber);
+
+	void setPredictor(const Predictor &predictor, const int &extrapolationSteps = 3);
+
+	void setParaviewFormat(const VTUFormat &format);
+
+	// XDMF writes every output step of the run to results/solidOutput.h5, indexed by results/solidOutput.xmf
+	void setResultsFormat(const ResultsFormat &format);
+
+	// Results and plotData are written by a background thread holding at most outputSnapshots pending outputs
+	void setAsynchronousOutput(const bool &asynchronousOutput, const int &outputSnapshots = 2);
+
+	// The plotData rows are buffered and written every bufferedRows steps (100 by default), also to
+	// plotData/time-series.bin if binary. Pending rows are written by flushOutput and after each arc-length step.
+	void setTimeSeriesOutput(const int &bufferedRows, const bool &binary = false);
+
+	void setConvergenceCriterion(const ConvergenceCriterion &criterion, const double &residualTolerance = 1.0e-8);
+
+	// errorTolerance bounds the local error relative to the displacement of the step. minDeltat = 0 stands for
+	// 1e-6 initialDeltat; a step rejected at the minimum deltat stops the analysis
+	void setAdaptiveTimeStepping(const double &errorTolerance, const double &initialDeltat, const double &minDeltat = 0.0, const double &maxDeltat = 0.0,
+								  const double &maxGrowth = 2.0, const double &minShrink = 0.25);
+
 	void addGraphic(std::string fileName, Variable variable, ConstrainedDOF direction, std::string pointName);
 	
 	void applyMaterial(const std::vector<Line *> lines, Material *&material);
@@ -66,6 +111,10 @@ public:
 
 	void solveTransientProblem();
 
+	void solveExplicitProblem();
+
+	void solveArcLengthProblem();
+
 	void solveStaggeredProblem(int &ndofsInterfaceForces,
 							   std::vector<DegreeOfFreedom *> &dofsInterfaceForces,
 							   double *&interfaceForces);
@@ -91,6 +140,11 @@ private:
 
 	void setPastVariables();
 
+	void restorePastVariables();
+
+	void predictPositions(const std::vector<char> &constrained, const std::vector<std::vector<double>> &history,
+						  const std::vector<double> &historyTimes, const double &time);
+
 	void computeCurrentVariables();
 
 	void computeIntermediateVariables();
@@ -107,22 +161,65 @@ private:
 
 	void assembleTransientLinearSystem(Mat &mat, Vec &vec);
 
+	// Receives (thread, element position, ndofs, indexes, rhs, hessian) for every local element
+	typedef std::function<void(const int &, const int &, const int &, const int *, const double *, const double *)> ElementConsumer;
+
+	void evaluateLocalElements(const ElementConsumer &consume, const bool &residualOnly = false);
+
+	void assembleLinearSystem(Mat &mat, Vec &vec);
+
+	void assembleResidual(Vec &vec, Mat preconditioner = nullptr);
+
+	int getLocalRow(const int &index) const;
+
+	void createMatrixFreeTangent(Mat &mat, Mat &preconditioner, const int &numberOfConstrainedDOFs, const int *constrainedDOFs);
+
+	void applyMatrixFreeTangent(Vec &x, Vec &y, const bool &diagonalOnly);
+
+	static PetscErrorCode matrixFreeMult(Mat mat, Vec x, Vec y);
+
+	static PetscErrorCode matrixFreeDiagonal(Mat mat, Vec diagonal);
+
+	bool scatterElementContributions(const int &element, const int &ndofs, const int *indexes,
+									 const double *rhsValues, const double *hessianValues,
+									 double *tangentValues, double *rhs) const;
+
 	void applyNeummanConditions(Vec &vec, int &ndofs, const std::vector<DegreeOfFreedom *> &dofsForces, double *&externalForces, const double &loadFactor);
 	
 	void applyNeummanConditions(Vec &vec, Mat &mat, int &ndofs, const std::vector<DegreeOfFreedom *> &dofsForces, double *&externalForces, const double &loadFactor);
 
-	void solveLinearSystem(KSP &ksp, Mat &mat, Vec &rhs, Vec &solution);
+	void configureLinearSolver(KSP &ksp, const SolverProfile &defaultProfile, const bool &matrixFree = false);
+
+	void attachNearNullSpace(Mat &mat, KSP &ksp);
+
+	// Returns true when the reused preconditioner failed and was rebuilt
+	bool solveLinearSystem(KSP &ksp, Mat &mat, Vec &rhs, Vec &solution, Mat preconditioner = nullptr);
 
 	void updateVariables(Vec &solution, double &positionNorm, double &pressureNorm);
 
+	bool checkResidualConvergence(Vec &rhs, Vec &lastIncrement, const int &iteration, double &referenceResidual, const double &referenceEnergy);
+
+	double globalizeNewtonStep(Vec &rhs, Vec &step, Vec &residual, Vec &increment,
+							   const std::function<void(Vec &)> &computeResidual,
+							   const std::function<void()> &refreshVariables, double &trustRadius,
+							   const std::function<double()> &computeEnergy = std::function<double()>());
+
 	void computeCauchyStress();
 
 	void computeInitialAccel();
 
-	void exportGraphicData(const int &timeStep);
+	double computeStableTimeStep();
+
+	void exportGraphicData(const double &time);
 
 	void exportToParaview(const int &step);
 
+	void writeTimeSeries();
+
+	void queueOutput(std::function<void()> task);
+
+	void flushOutput();
+
 	void readInput(const std::string &inputFile, const bool &deleteFiles, const PartitionOfUnity elementType);
 
 	void transferGeometricBoundaryConditions();
@@ -135,8 +232,22 @@ private:
 
 	void elementalNeighborSearch() const;
 
+	void elementColoring();
+
+	void buildReferenceGeometryCache(const ReferenceConfiguration &reference);
+
+	void buildSystemPattern();
+
 	void createSystemMatrix(Mat &mat);
 
+	void createSystemVectors(Vec &rhs, Vec &solution);
+
+	void gatherNodalVariables(const bool &toAllRanks);
+
+	void gatherNodalVariables(const std::vector<DegreeOfFreedom *> &dofs);
+
+	void createOwnedNodalVariables(Vec &owned);
+
 	void reorderDOFs();
 
 	void domainDecomposition();
@@ -156,6 +267,7 @@ private:
 	Geometry *geometry_;
 	Mesher *remesh_;
 	std::vector<Node *> nodes_;
+	DegreeOfFreedomStore dofStore_; // state of every dof, contiguous and in index order once the dofs are reordered
 	std::vector<Node *> interfaceNodes_;
 	std::vector<Element *> elements_;
 	std::vector<Material *> materials_;
@@ -165,9 +277,41 @@ private:
 	idx_t *elementPartition_;
 	idx_t *nodePartition_;
 	idx_t *perm_;
+	double assemblyTime_;
+	double stateUpdateTime_; // setPastVariables, computeCurrentVariables and computeIntermediateVariables
+	int stateUpdates_;
 
 	std::vector<OutputGraphic *> outputGraphics_;
-
+	std::vector<std::vector<int>> elementColors_; // local elements grouped so that no two elements of a color share a node
+	std::vector<std::vector<int>> colorBatches_;  // offsets of the element batches inside each color
+	std::vector<double> referenceGeometry_;       // weight * j0 and dphi_dx of the local elements at their quadrature points
+	std::vector<int> stressContributions_;        // elements of all ranks averaged into each nodal stress
+
+	// Sparsity pattern of the owned rows of the tangent matrix, rebuilt only when the mesh topology changes
+	bool systemPatternOutdated_;
+	int firstOwnedRow_;
+	int numberOfOwnedRows_;
+	std::vector<int> rowPointer_;
+	std::vector<int> columnIndexes_;
+	std::vector<double> tangentValues_;
+	std::vector<DegreeOfFreedom *> localDOFs_; // owned dofs in crescent order of index followed by the ghost ones
+	std::vector<int> ghostIndexes_;
+	std::vector<int> positionIndexes_; // blocked dofs of each field in crescent order, the splits of the fieldsplit solver
+	std::vector<int> pressureIndexes_;
+	SolverProfile linearSolverProfile_; // profile resolved by the last configureLinearSolver
+	std::vector<int> elementSlotOffsets_;
+	std::vector<int> elementSlots_; // CSR value slot of each local element matrix entry (-1 for rows owned elsewhere)
+
+	// Matrix-free tangent: ghosted work vectors and the Dirichlet flag of every local (owned, then ghost) row
+	Vec matrixFreeInput_;
+	Vec matrixFreeOutput_;
+	std::vector<char> matrixFreeConstrained_;
+	int matrixFreeProducts_;
+	double matrixFreeTime_;
+
+	OutputQueue *outputQueue_;       // background writer of the results, created at the first asynchronous output
+	XDMFWriter *xdmfWriter_;         // created at the first XDMF output
+	TimeSeriesRecorder *timeSeries_; // buffered plotData rows (rank 0)
 
 public:
 	friend class CoupledDomain;
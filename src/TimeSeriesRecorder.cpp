@@ -0,0 +1,90 @@
+#include "TimeSeriesRecorder.h"
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+
+TimeSeriesRecorder::TimeSeriesRecorder(const std::string &directory, const std::vector<std::string> &names, const bool &binary)
+    : directory_(directory),
+      names_(names),
+      binary_(binary),
+      headerWritten_(false) {}
+
+TimeSeriesRecorder::~TimeSeriesRecorder() {}
+
+void TimeSeriesRecorder::addRow(const double &time, const std::vector<double> &values)
+{
+    rows_.push_back(time);
+    rows_.insert(rows_.end(), values.begin(), values.end());
+}
+
+int TimeSeriesRecorder::getNumberOfBufferedRows() const
+{
+    return rows_.size() / (names_.size() + 1);
+}
+
+std::vector<double> TimeSeriesRecorder::takeRows()
+{
+    std::vector<double> rows;
+    rows.swap(rows_);
+    return rows;
+}
+
+void TimeSeriesRecorder::write(const std::vector<double> &rows)
+{
+    const unsigned int numberOfColumns = names_.size() + 1;
+    const uint64_t numberOfRows = rows.size() / numberOfColumns;
+    if (numberOfRows == 0)
+        return;
+
+    for (unsigned int s = 0; s < names_.size(); s++)
+    {
+        const std::string filePath = directory_ + "/" + names_[s] + ".dat";
+        std::ofstream file(filePath, std::ios::app);
+        if (file.fail())
+        {
+            std::cerr << "\nCan't open the file '" << filePath << "'.\n";
+            exit(EXIT_FAILURE);
+        }
+        file.precision(8);
+        file.setf(std::ios::scientific, std::ios::floatfield);
+        for (uint64_t r = 0; r < numberOfRows; r++)
+        {
+            file.width(20);
+            file << std::left << rows[r * numberOfColumns];
+            file.width(20);
+            file << std::left << rows[r * numberOfColumns + s + 1];
+            file << "\n";
+        }
+        file.close();
+    }
+
+    if (!binary_)
+        return;
+
+    const std::string filePath = directory_ + "/time-series.bin";
+    std::ofstream file(filePath, headerWritten_ ? std::ios::binary | std::ios::app : std::ios::binary | std::ios::trunc);
+    if (file.fail())
+    {
+        std::cerr << "\nCan't open the file '" << filePath << "'.\n";
+        exit(EXIT_FAILURE);
+    }
+    if (!headerWritten_)
+    {
+        const uint64_t columns = numberOfColumns;
+        file.write("TSERIES1", 8);
+        file.write(reinterpret_cast<const char *>(&columns), sizeof(uint64_t));
+        file.write("time", 5);
+        for (const std::string &name : names_)
+            file.write(name.c_str(), name.size() + 1);
+        headerWritten_ = true;
+    }
+
+    // the block is transposed so that each column is contiguous
+    std::vector<double> columns(rows.size());
+    for (uint64_t r = 0; r < numberOfRows; r++)
+        for (unsigned int c = 0; c < numberOfColumns; c++)
+            columns[c * numberOfRows + r] = rows[r * numberOfColumns + c];
+    file.write(reinterpret_cast<const char *>(&numberOfRows), sizeof(uint64_t));
+    file.write(reinterpret_cast<const char *>(columns.data()), columns.size() * sizeof(double));
+    file.close();
+}
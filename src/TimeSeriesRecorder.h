@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// In-memory recorder of the plotData series, which all share the time (or load factor) column. The rows are
+// buffered and written in blocks, so each file is opened once per block instead of once per step: one
+// <directory>/<name>.dat text file per series and, optionally, the binary file <directory>/time-series.bin with
+// the layout
+//   "TSERIES1", uint64 number of columns, the column names ("time" first) each ended by '\0',
+//   then per written block: uint64 number of rows followed by every column as contiguous float64 values.
+class TimeSeriesRecorder
+{
+public:
+    TimeSeriesRecorder(const std::string &directory, const std::vector<std::string> &names, const bool &binary);
+
+    ~TimeSeriesRecorder();
+
+    void addRow(const double &time, const std::vector<double> &values);
+
+    int getNumberOfBufferedRows() const;
+
+    // Moves the buffered rows out, row-major with the time first, to be handed to write
+    std::vector<double> takeRows();
+
+    // Appends the rows to the files. Calls must be made in the order the rows were taken
+    void write(const std::vector<double> &rows);
+
+private:
+    std::string directory_;
+    std::vector<std::string> names_;
+    bool binary_;
+    bool headerWritten_;
+    std::vector<double> rows_;
+};
@@ -0,0 +1,288 @@
+#include "VTUWriter.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+VTUWriter::VTUWriter(const VTUFormat &format)
+    : format_(format)
+{
+#ifndef HAVE_ZLIB
+    if (format_ == VTUFormat::APPENDED_ZLIB)
+    {
+        std::cerr << "VTUWriter: built without zlib, writing uncompressed appended data.\n";
+        format_ = VTUFormat::APPENDED_RAW;
+    }
+#endif
+}
+
+VTUWriter::~VTUWriter() {}
+
+template <class T>
+VTUWriter::DataArray VTUWriter::makeDataArray(const std::string &name, const DataType &type, const int &numberOfComponents, std::vector<T> &values)
+{
+    DataArray array;
+    array.name = name;
+    array.type = type;
+    array.numberOfComponents = numberOfComponents;
+    array.bytes.resize(values.size() * sizeof(T));
+    if (!values.empty())
+        std::memcpy(array.bytes.data(), values.data(), array.bytes.size());
+    std::vector<T>().swap(values);
+    return array;
+}
+
+void VTUWriter::setPoints(std::vector<double> &coordinates)
+{
+    points_ = makeDataArray(std::string(), DataType::FLOAT64, 3, coordinates);
+}
+
+void VTUWriter::setCells(std::vector<int32_t> &connectivity, std::vector<int32_t> &offsets, std::vector<uint8_t> &types)
+{
+    cells_.clear();
+    cells_.push_back(makeDataArray("connectivity", DataType::INT32, 1, connectivity));
+    cells_.push_back(makeDataArray("offsets", DataType::INT32, 1, offsets));
+    cells_.push_back(makeDataArray("types", DataType::UINT8, 1, types));
+}
+
+void VTUWriter::addPointData(const std::string &name, const int &numberOfComponents, std::vector<double> &values)
+{
+    pointData_.push_back(makeDataArray(name, DataType::FLOAT64, numberOfComponents, values));
+}
+
+void VTUWriter::addCellData(const std::string &name, const int &numberOfComponents, std::vector<double> &values)
+{
+    cellData_.push_back(makeDataArray(name, DataType::FLOAT64, numberOfComponents, values));
+}
+
+int VTUWriter::getNumberOfPoints() const
+{
+    return points_.bytes.size() / (3 * sizeof(double));
+}
+
+int VTUWriter::getNumberOfCells() const
+{
+    return cells_.empty() ? 0 : cells_[1].bytes.size() / sizeof(int32_t);
+}
+
+const char *VTUWriter::getTypeName(const DataType &type)
+{
+    switch (type)
+    {
+    case DataType::FLOAT64:
+        return "Float64";
+    case DataType::INT32:
+        return "Int32";
+    default:
+        return "UInt8";
+    }
+}
+
+size_t VTUWriter::getTypeSize(const DataType &type)
+{
+    switch (type)
+    {
+    case DataType::FLOAT64:
+        return sizeof(double);
+    case DataType::INT32:
+        return sizeof(int32_t);
+    default:
+        return sizeof(uint8_t);
+    }
+}
+
+std::vector<char> VTUWriter::encode(const DataArray &array) const
+{
+    std::vector<char> block;
+    const uint64_t size = array.bytes.size();
+#ifdef HAVE_ZLIB
+    if (format_ == VTUFormat::APPENDED_ZLIB)
+    {
+        // vtkZLibDataCompressor layout: [number of blocks, block size, last block size, compressed sizes...] + blocks
+        const uint64_t blockSize = 1 << 16;
+        const uint64_t numberOfBlocks = (size + blockSize - 1) / blockSize;
+        std::vector<uint64_t> header(3 + numberOfBlocks);
+        header[0] = numberOfBlocks;
+        header[1] = blockSize;
+        header[2] = size % blockSize; // 0 when the last block is full
+
+        std::vector<char> compressed;
+        for (uint64_t b = 0; b < numberOfBlocks; b++)
+        {
+            const uLong sourceSize = std::min(blockSize, size - b * blockSize);
+            uLongf compressedSize = compressBound(sourceSize);
+            const size_t start = compressed.size();
+            compressed.resize(start + compressedSize);
+            compress2(reinterpret_cast<Bytef *>(compressed.data() + start), &compressedSize,
+                      reinterpret_cast<const Bytef *>(array.bytes.data() + b * blockSize), sourceSize, Z_BEST_SPEED);
+            compressed.resize(start + compressedSize);
+            header[3 + b] = compressedSize;
+        }
+
+        block.resize(header.size() * sizeof(uint64_t) + compressed.size());
+        std::memcpy(block.data(), header.data(), header.size() * sizeof(uint64_t));
+        if (!compressed.empty())
+            std::memcpy(block.data() + header.size() * sizeof(uint64_t), compressed.data(), compressed.size());
+        return block;
+    }
+#endif
+    block.resize(sizeof(uint64_t) + size);
+    std::memcpy(block.data(), &size, sizeof(uint64_t));
+    if (size > 0)
+        std::memcpy(block.data() + sizeof(uint64_t), array.bytes.data(), size);
+    return block;
+}
+
+void VTUWriter::writeHeader(std::ostream &file, const DataArray &array, const size_t &offset) const
+{
+    file << "      <DataArray type=\"" << getTypeName(array.type) << "\"";
+    if (!array.name.empty())
+        file << " Name=\"" << array.name << "\"";
+    file << " NumberOfComponents=\"" << array.numberOfComponents << "\"";
+    if (format_ == VTUFormat::ASCII)
+        file << " format=\"ascii\">\n";
+    else
+        file << " format=\"appended\" offset=\"" << offset << "\"/>\n";
+}
+
+void VTUWriter::writeASCII(std::ostream &file, const DataArray &array) const
+{
+    const size_t count = array.bytes.size() / getTypeSize(array.type);
+    const int components = array.numberOfComponents;
+    for (size_t i = 0; i < count; i++)
+    {
+        switch (array.type)
+        {
+        case DataType::FLOAT64:
+            file << reinterpret_cast<const double *>(array.bytes.data())[i];
+            break;
+        case DataType::INT32:
+            file << reinterpret_cast<const int32_t *>(array.bytes.data())[i];
+            break;
+        default:
+            file << (int)reinterpret_cast<const uint8_t *>(array.bytes.data())[i];
+            break;
+        }
+        file << (((i + 1) % components == 0) ? "\n" : " ");
+    }
+    file << "      </DataArray>\n";
+}
+
+void VTUWriter::write(const std::string &fileName) const
+{
+    std::ofstream file(fileName, std::ios::binary);
+    if (file.fail())
+    {
+        std::cerr << "\nCan't open the file '" << fileName << "'.\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // Appended blocks in the order the arrays are declared
+    std::vector<const DataArray *> arrays;
+    arrays.push_back(&points_);
+    for (const DataArray &array : cells_)
+        arrays.push_back(&array);
+    for (const DataArray &array : pointData_)
+        arrays.push_back(&array);
+    for (const DataArray &array : cellData_)
+        arrays.push_back(&array);
+
+    std::vector<std::vector<char>> blocks;
+    std::vector<size_t> offsets(arrays.size(), 0);
+    if (format_ != VTUFormat::ASCII)
+    {
+        blocks.reserve(arrays.size());
+        size_t offset = 0;
+        for (unsigned int i = 0; i < arrays.size(); i++)
+        {
+            blocks.push_back(encode(*arrays[i]));
+            offsets[i] = offset;
+            offset += blocks.back().size();
+        }
+    }
+
+    file << "<?xml version=\"1.0\"?>\n"
+         << "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\"LittleEndian\" header_type=\"UInt64\"";
+    if (format_ == VTUFormat::APPENDED_ZLIB)
+        file << " compressor=\"vtkZLibDataCompressor\"";
+    file << ">\n"
+         << "  <UnstructuredGrid>\n"
+         << "  <Piece NumberOfPoints=\"" << getNumberOfPoints() << "\"  NumberOfCells=\"" << getNumberOfCells() << "\">\n";
+
+    auto writeArray = [&](const unsigned int &i)
+    {
+        writeHeader(file, *arrays[i], offsets[i]);
+        if (format_ == VTUFormat::ASCII)
+            writeASCII(file, *arrays[i]);
+    };
+
+    unsigned int a = 0;
+    file << "    <Points>\n";
+    writeArray(a++);
+    file << "    </Points>\n"
+         << "    <Cells>\n";
+    for (unsigned int i = 0; i < cells_.size(); i++)
+        writeArray(a++);
+    file << "    </Cells>\n"
+         << "    <PointData>\n";
+    for (unsigned int i = 0; i < pointData_.size(); i++)
+        writeArray(a++);
+    file << "    </PointData>\n"
+         << "    <CellData>\n";
+    for (unsigned int i = 0; i < cellData_.size(); i++)
+        writeArray(a++);
+    file << "    </CellData>\n"
+         << "  </Piece>\n"
+         << "  </UnstructuredGrid>\n";
+
+    if (format_ != VTUFormat::ASCII)
+    {
+        file << "  <AppendedData encoding=\"raw\">\n_";
+        for (const std::vector<char> &block : blocks)
+            file.write(block.data(), block.size());
+        file << "\n  </AppendedData>\n";
+    }
+    file << "</VTKFile>\n";
+    file.close();
+}
+
+void VTUWriter::writeParallelIndex(const std::string &fileName, const std::vector<std::string> &pieces) const
+{
+    std::ofstream file(fileName);
+    if (file.fail())
+    {
+        std::cerr << "\nCan't open the file '" << fileName << "'.\n";
+        exit(EXIT_FAILURE);
+    }
+
+    auto writeArray = [&](const DataArray &array)
+    {
+        file << "      <PDataArray type=\"" << getTypeName(array.type) << "\"";
+        if (!array.name.empty())
+            file << " Name=\"" << array.name << "\"";
+        file << " NumberOfComponents=\"" << array.numberOfComponents << "\"/>\n";
+    };
+
+    file << "<?xml version=\"1.0\"?>\n"
+         << "<VTKFile type=\"PUnstructuredGrid\" version=\"1.0\" byte_order=\"LittleEndian\" header_type=\"UInt64\">\n"
+         << "  <PUnstructuredGrid GhostLevel=\"0\">\n"
+         << "    <PPoints>\n";
+    writeArray(points_);
+    file << "    </PPoints>\n"
+         << "    <PPointData>\n";
+    for (const DataArray &array : pointData_)
+        writeArray(array);
+    file << "    </PPointData>\n"
+         << "    <PCellData>\n";
+    for (const DataArray &array : cellData_)
+        writeArray(array);
+    file << "    </PCellData>\n";
+    for (const std::string &piece : pieces)
+        file << "    <Piece Source=\"" << piece << "\"/>\n";
+    file << "  </PUnstructuredGrid>\n"
+         << "</VTKFile>\n";
+    file.close();
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "mesh_interface/Enums.h"
+
+// Writer of VTK unstructured grid (.vtu) files and of the .pvtu index of a partitioned output. The DataArrays are
+// handed over as contiguous buffers, so the binary formats write each one with a single call.
+class VTUWriter
+{
+public:
+    VTUWriter(const VTUFormat &format);
+
+    ~VTUWriter();
+
+    void setPoints(std::vector<double> &coordinates);
+
+    void setCells(std::vector<int32_t> &connectivity, std::vector<int32_t> &offsets, std::vector<uint8_t> &types);
+
+    void addPointData(const std::string &name, const int &numberOfComponents, std::vector<double> &values);
+
+    void addCellData(const std::string &name, const int &numberOfComponents, std::vector<double> &values);
+
+    int getNumberOfPoints() const;
+
+    int getNumberOfCells() const;
+
+    void write(const std::string &fileName) const;
+
+    // Writes the .pvtu that joins the pieces (paths relative to it), each holding the same arrays as this writer
+    void writeParallelIndex(const std::string &fileName, const std::vector<std::string> &pieces) const;
+
+private:
+    friend class XDMFWriter;
+
+    enum class DataType
+    {
+        FLOAT64,
+        INT32,
+        UINT8
+    };
+
+    struct DataArray
+    {
+        std::string name;
+        DataType type;
+        int numberOfComponents;
+        std::vector<char> bytes;
+    };
+
+    // The buffers are moved into the writer
+    template <class T>
+    static DataArray makeDataArray(const std::string &name, const DataType &type, const int &numberOfComponents, std::vector<T> &values);
+
+    static const char *getTypeName(const DataType &type);
+
+    static size_t getTypeSize(const DataType &type);
+
+    // Bytes of the appended block of an array: a UInt64 header followed by the (possibly compressed) data
+    std::vector<char> encode(const DataArray &array) const;
+
+    void writeHeader(std::ostream &file, const DataArray &array, const size_t &offset) const;
+
+    void writeASCII(std::ostream &file, const DataArray &array) const;
+
+    VTUFormat format_;
+    DataArray points_;
+    std::vector<DataArray> cells_;
+    std::vector<DataArray> pointData_;
+    std::vector<DataArray> cellData_;
+};
@@ -0,0 +1,416 @@
+#ifdef HAVE_HDF5
+#include "XDMFWriter.h"
+#include <hdf5.h>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <vtkCellType.h>
+
+// Concatenates the vectors of every rank on rank 0, in rank order
+template <class T>
+static void gatherOnZero(std::vector<T> &values, MPI_Datatype type, MPI_Comm comm)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    int count = values.size();
+    std::vector<int> counts(size, 0), displacements(size, 0);
+    MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, comm);
+    std::vector<T> gathered;
+    if (rank == 0)
+    {
+        for (int r = 1; r < size; r++)
+            displacements[r] = displacements[r - 1] + counts[r - 1];
+        gathered.resize(displacements[size - 1] + counts[size - 1]);
+    }
+    MPI_Gatherv(values.data(), count, type, gathered.data(), counts.data(), displacements.data(), type, 0, comm);
+    values.swap(gathered);
+}
+
+// Dataset of rows x components that grows by one step along the first dimension, one step per chunk
+static void createSeries(const hid_t &file, const std::string &name, const int &numberOfComponents, const uint64_t &rows)
+{
+    hsize_t dims[3] = {0, rows, (hsize_t)numberOfComponents};
+    hsize_t maxDims[3] = {H5S_UNLIMITED, H5S_UNLIMITED, (hsize_t)numberOfComponents};
+    hsize_t chunk[3] = {1, std::max<hsize_t>(rows, 1), (hsize_t)numberOfComponents};
+    hid_t space = H5Screate_simple(3, dims, maxDims);
+    hid_t creation = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(creation, 3, chunk);
+    hid_t dataset = H5Dcreate2(file, name.c_str(), H5T_NATIVE_DOUBLE, space, H5P_DEFAULT, creation, H5P_DEFAULT);
+    H5Dclose(dataset);
+    H5Pclose(creation);
+    H5Sclose(space);
+}
+
+// Writes the rows [offset, offset + rows) of the step, after extending the dataset to hold it
+static void appendRows(const hid_t &file, const std::string &name, const int &step, const std::vector<double> &values,
+                       const int &numberOfComponents, const uint64_t &rows, const uint64_t &offset, const uint64_t &totalRows,
+                       const hid_t &transfer)
+{
+    hid_t dataset = H5Dopen2(file, name.c_str(), H5P_DEFAULT);
+    hsize_t dims[3] = {(hsize_t)step + 1, totalRows, (hsize_t)numberOfComponents};
+    H5Dset_extent(dataset, dims);
+
+    hid_t fileSpace = H5Dget_space(dataset);
+    hsize_t start[3] = {(hsize_t)step, offset, 0};
+    hsize_t count[3] = {1, rows, (hsize_t)numberOfComponents};
+    hsize_t size = rows * numberOfComponents;
+    hid_t memorySpace = H5Screate_simple(1, &size, NULL);
+    if (size > 0)
+        H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, start, NULL, count, NULL);
+    else
+    {
+        H5Sselect_none(fileSpace);
+        H5Sselect_none(memorySpace);
+    }
+    const double empty = 0.0; // HDF5 rejects a null buffer even when nothing is selected
+    H5Dwrite(dataset, H5T_NATIVE_DOUBLE, memorySpace, fileSpace, transfer, values.empty() ? &empty : values.data());
+    H5Sclose(memorySpace);
+    H5Sclose(fileSpace);
+    H5Dclose(dataset);
+}
+
+XDMFWriter::XDMFWriter(const std::string &fileName, MPI_Comm comm, const int &dimension)
+    : fileName_(fileName),
+      comm_(comm),
+      dimension_(dimension),
+      parallel_(false),
+      meshGeneration_(-1),
+      fileCreated_(false),
+      indexTail_(-1)
+{
+    // writeStep may run on the output thread, which must not call MPI
+    MPI_Comm_rank(comm_, &rank_);
+#ifdef H5_HAVE_PARALLEL
+    int size;
+    MPI_Comm_size(comm_, &size);
+    parallel_ = size > 1;
+#endif
+}
+
+XDMFWriter::~XDMFWriter() {}
+
+bool XDMFWriter::isParallel() const
+{
+    return parallel_;
+}
+
+std::vector<int32_t> XDMFWriter::buildTopology(const VTUWriter &piece, const uint64_t &pointOffset)
+{
+    // XDMF mixed topology: the type of each cell followed by its nodes (and by their number for polylines). The
+    // VTK Lagrange cells list their corners first, so the cubic ones, which XDMF lacks, are written as linear cells
+    const uint64_t numberOfCells = piece.getNumberOfCells();
+    std::vector<int32_t> topology;
+    if (numberOfCells == 0)
+        return topology;
+
+    const int32_t *connectivity = reinterpret_cast<const int32_t *>(piece.cells_[0].bytes.data());
+    const int32_t *offsets = reinterpret_cast<const int32_t *>(piece.cells_[1].bytes.data());
+    const uint8_t *types = reinterpret_cast<const uint8_t *>(piece.cells_[2].bytes.data());
+    topology.reserve(offsets[numberOfCells - 1] + 2 * numberOfCells);
+
+    int32_t begin = 0;
+    for (uint64_t c = 0; c < numberOfCells; c++)
+    {
+        int numberOfNodes = offsets[c] - begin;
+        switch (types[c])
+        {
+        case VTK_LAGRANGE_CURVE:
+            if (numberOfNodes == 3)
+                topology.push_back(34); // Edge_3
+            else
+            {
+                numberOfNodes = 2;
+                topology.push_back(2); // Polyline
+                topology.push_back(2);
+            }
+            break;
+        case VTK_LAGRANGE_TRIANGLE:
+            if (numberOfNodes == 6)
+                topology.push_back(36); // Triangle_6
+            else
+            {
+                numberOfNodes = 3;
+                topology.push_back(4); // Triangle
+            }
+            break;
+        case VTK_LAGRANGE_QUADRILATERAL:
+            if (numberOfNodes == 9)
+                topology.push_back(38); // Quadrilateral_9
+            else
+            {
+                numberOfNodes = 4;
+                topology.push_back(5); // Quadrilateral
+            }
+            break;
+        default:
+            std::cerr << "XDMFWriter: VTK cell type " << (int)types[c] << " is not supported.\n";
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < numberOfNodes; i++)
+            topology.push_back(connectivity[begin + i] + pointOffset);
+        begin = offsets[c];
+    }
+    return topology;
+}
+
+void XDMFWriter::takeArray(VTUWriter::DataArray &array, std::vector<Array> &arrays) const
+{
+    Array taken;
+    taken.name = array.name;
+    taken.numberOfComponents = array.numberOfComponents;
+    taken.values.resize(array.bytes.size() / sizeof(double));
+    std::copy(array.bytes.begin(), array.bytes.end(), reinterpret_cast<char *>(taken.values.data()));
+    std::vector<char>().swap(array.bytes);
+
+    // XDMF vectors have 3 components, like the geometry, and it has no 2D symmetric tensor: in 2D the vectors are
+    // padded with a zero z and the (xx, yy, xy) tensors are split in scalars
+    const int numberOfComponents = taken.numberOfComponents;
+    const size_t rows = (numberOfComponents > 0) ? taken.values.size() / numberOfComponents : 0;
+    if (dimension_ == 2 && numberOfComponents == 2)
+    {
+        std::vector<double> padded(3 * rows, 0.0);
+        for (size_t r = 0; r < rows; r++)
+        {
+            padded[3 * r] = taken.values[2 * r];
+            padded[3 * r + 1] = taken.values[2 * r + 1];
+        }
+        taken.numberOfComponents = 3;
+        taken.values.swap(padded);
+    }
+    else if (dimension_ == 2 && numberOfComponents == 3)
+    {
+        const char *suffixes[3] = {"XX", "YY", "XY"};
+        for (int c = 0; c < 3; c++)
+        {
+            Array component;
+            component.name = taken.name + suffixes[c];
+            component.numberOfComponents = 1;
+            component.values.resize(rows);
+            for (size_t r = 0; r < rows; r++)
+                component.values[r] = taken.values[3 * r + c];
+            arrays.push_back(std::move(component));
+        }
+        return;
+    }
+    arrays.push_back(std::move(taken));
+}
+
+std::shared_ptr<XDMFWriter::Step> XDMFWriter::prepareStep(const double &time, VTUWriter &piece)
+{
+    int rank, size;
+    MPI_Comm_rank(comm_, &rank);
+    MPI_Comm_size(comm_, &size);
+
+    std::shared_ptr<Step> step = std::make_shared<Step>();
+    step->time = time;
+
+    // position of the local rows in the global datasets
+    uint64_t counts[3] = {(uint64_t)piece.getNumberOfPoints(), (uint64_t)piece.getNumberOfCells(), 0};
+    uint64_t offsets[3] = {0, 0, 0};
+    MPI_Exscan(counts, offsets, 2, MPI_UINT64_T, MPI_SUM, comm_);
+    if (rank == 0)
+        offsets[0] = offsets[1] = 0;
+    std::vector<int32_t> topology = buildTopology(piece, offsets[0]);
+    counts[2] = topology.size();
+    MPI_Exscan(&counts[2], &offsets[2], 1, MPI_UINT64_T, MPI_SUM, comm_);
+    if (rank == 0)
+        offsets[2] = 0;
+
+    step->numberOfPoints[0] = counts[0];
+    step->numberOfCells[0] = counts[1];
+    step->topologySize[0] = counts[2];
+    step->pointOffset = offsets[0];
+    step->cellOffset = offsets[1];
+    step->topologyOffset = offsets[2];
+    MPI_Allreduce(MPI_IN_PLACE, counts, 3, MPI_UINT64_T, MPI_SUM, comm_);
+    step->numberOfPoints[1] = counts[0];
+    step->numberOfCells[1] = counts[1];
+    step->topologySize[1] = counts[2];
+
+    // a new mesh generation when the topology of any rank changes
+    int changed = (meshGeneration_ < 0 || topology != lastTopology_) ? 1 : 0;
+    MPI_Allreduce(MPI_IN_PLACE, &changed, 1, MPI_INT, MPI_LOR, comm_);
+    step->newMesh = changed;
+    if (changed)
+    {
+        meshGeneration_++;
+        lastTopology_ = topology;
+        step->topology.swap(topology);
+    }
+    step->meshGeneration = meshGeneration_;
+
+    step->coordinates.resize(piece.points_.bytes.size() / sizeof(double));
+    std::copy(piece.points_.bytes.begin(), piece.points_.bytes.end(), reinterpret_cast<char *>(step->coordinates.data()));
+    std::vector<char>().swap(piece.points_.bytes);
+    for (VTUWriter::DataArray &array : piece.pointData_)
+        takeArray(array, step->pointData);
+    for (VTUWriter::DataArray &array : piece.cellData_)
+        takeArray(array, step->cellData);
+    piece.cells_.clear();
+    piece.pointData_.clear();
+    piece.cellData_.clear();
+
+    if (parallel_ || size == 1)
+        return step;
+
+    gatherOnZero(step->topology, MPI_INT32_T, comm_);
+    gatherOnZero(step->coordinates, MPI_DOUBLE, comm_);
+    for (Array &array : step->pointData)
+        gatherOnZero(array.values, MPI_DOUBLE, comm_);
+    for (Array &array : step->cellData)
+        gatherOnZero(array.values, MPI_DOUBLE, comm_);
+    if (rank != 0)
+        return nullptr;
+
+    step->numberOfPoints[0] = step->numberOfPoints[1];
+    step->numberOfCells[0] = step->numberOfCells[1];
+    step->topologySize[0] = step->topologySize[1];
+    step->pointOffset = step->cellOffset = step->topologyOffset = 0;
+    return step;
+}
+
+void XDMFWriter::writeStep(const Step &step)
+{
+    const std::string h5Name = fileName_ + ".h5";
+    hid_t access = H5Pcreate(H5P_FILE_ACCESS);
+    hid_t transfer = H5Pcreate(H5P_DATASET_XFER);
+#ifdef H5_HAVE_PARALLEL
+    if (parallel_)
+    {
+        H5Pset_fapl_mpio(access, comm_, MPI_INFO_NULL);
+        H5Pset_dxpl_mpio(transfer, H5FD_MPIO_COLLECTIVE);
+    }
+#endif
+    hid_t file = fileCreated_ ? H5Fopen(h5Name.c_str(), H5F_ACC_RDWR, access)
+                              : H5Fcreate(h5Name.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, access);
+    if (file < 0)
+    {
+        std::cerr << "\nCan't open the file '" << h5Name << "'.\n";
+        exit(EXIT_FAILURE);
+    }
+    fileCreated_ = true;
+
+    const std::string group = "/Mesh" + std::to_string(step.meshGeneration);
+    if (step.newMesh)
+    {
+        meshes_.push_back({step.meshGeneration, 0, step.numberOfPoints[1], step.numberOfCells[1], step.topologySize[1]});
+        hid_t meshGroup = H5Gcreate2(file, group.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        H5Gclose(meshGroup);
+
+        hsize_t size = step.topologySize[1];
+        hsize_t localSize = step.topologySize[0];
+        hsize_t offset = step.topologyOffset;
+        hid_t fileSpace = H5Screate_simple(1, &size, NULL);
+        hid_t memorySpace = H5Screate_simple(1, &localSize, NULL);
+        hid_t dataset = H5Dcreate2(file, (group + "/Topology").c_str(), H5T_NATIVE_INT32, fileSpace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        if (localSize > 0)
+            H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, &offset, NULL, &localSize, NULL);
+        else
+        {
+            H5Sselect_none(fileSpace);
+            H5Sselect_none(memorySpace);
+        }
+        const int32_t empty = 0;
+        H5Dwrite(dataset, H5T_NATIVE_INT32, memorySpace, fileSpace, transfer, step.topology.empty() ? &empty : step.topology.data());
+        H5Dclose(dataset);
+        H5Sclose(memorySpace);
+        H5Sclose(fileSpace);
+
+        createSeries(file, group + "/Geometry", 3, step.numberOfPoints[1]);
+        for (const Array &array : step.pointData)
+            createSeries(file, group + "/" + array.name, array.numberOfComponents, step.numberOfPoints[1]);
+        for (const Array &array : step.cellData)
+            createSeries(file, group + "/" + array.name, array.numberOfComponents, step.numberOfCells[1]);
+    }
+
+    Mesh &mesh = meshes_.back();
+    appendRows(file, group + "/Geometry", mesh.numberOfSteps, step.coordinates, 3,
+               step.numberOfPoints[0], step.pointOffset, step.numberOfPoints[1], transfer);
+    for (const Array &array : step.pointData)
+        appendRows(file, group + "/" + array.name, mesh.numberOfSteps, array.values, array.numberOfComponents,
+                   step.numberOfPoints[0], step.pointOffset, step.numberOfPoints[1], transfer);
+    for (const Array &array : step.cellData)
+        appendRows(file, group + "/" + array.name, mesh.numberOfSteps, array.values, array.numberOfComponents,
+                   step.numberOfCells[0], step.cellOffset, step.numberOfCells[1], transfer);
+    mesh.numberOfSteps++;
+
+    H5Fclose(file);
+    H5Pclose(transfer);
+    H5Pclose(access);
+
+    if (rank_ == 0)
+        writeIndex(step, mesh);
+}
+
+void XDMFWriter::writeIndex(const Step &step, const Mesh &mesh)
+{
+    // The new grid overwrites the closing tags, which are written again after it
+    const std::string xmfName = fileName_ + ".xmf";
+    if (indexTail_ < 0)
+    {
+        std::ofstream header(xmfName);
+        header << "<?xml version=\"1.0\" ?>\n"
+               << "<!DOCTYPE Xdmf SYSTEM \"Xdmf.dtd\" []>\n"
+               << "<Xdmf Version=\"2.0\">\n"
+               << "  <Domain>\n"
+               << "    <Grid Name=\"TimeSeries\" GridType=\"Collection\" CollectionType=\"Temporal\">\n";
+        indexTail_ = header.tellp();
+        header.close();
+    }
+
+    std::fstream file(xmfName, std::ios::in | std::ios::out);
+    if (file.fail())
+    {
+        std::cerr << "\nCan't open the file '" << xmfName << "'.\n";
+        exit(EXIT_FAILURE);
+    }
+    file.seekp(indexTail_);
+    file.precision(16);
+
+    const std::string h5Name = fileName_.substr(fileName_.find_last_of('/') + 1) + ".h5";
+    const std::string group = h5Name + ":/Mesh" + std::to_string(mesh.generation);
+    const int stepInMesh = mesh.numberOfSteps - 1;
+    int numberOfSteps = 0;
+    for (const Mesh &m : meshes_)
+        numberOfSteps += m.numberOfSteps;
+
+    auto writeHyperSlab = [&](const std::string &name, const uint64_t &rows, const int &numberOfComponents)
+    {
+        file << "          <DataItem ItemType=\"HyperSlab\" Dimensions=\"" << rows << " " << numberOfComponents << "\" Type=\"HyperSlab\">\n"
+             << "            <DataItem Dimensions=\"3 3\" Format=\"XML\">" << stepInMesh << " 0 0 1 1 1 1 " << rows << " " << numberOfComponents << "</DataItem>\n"
+             << "            <DataItem Dimensions=\"" << mesh.numberOfSteps << " " << rows << " " << numberOfComponents
+             << "\" NumberType=\"Float\" Precision=\"8\" Format=\"HDF\">" << group << "/" << name << "</DataItem>\n"
+             << "          </DataItem>\n";
+    };
+    auto writeAttribute = [&](const Array &array, const std::string &center, const uint64_t &rows)
+    {
+        const char *type = (array.numberOfComponents == 1) ? "Scalar" : ((array.numberOfComponents == 3) ? "Vector" : ((array.numberOfComponents == 6) ? "Tensor6" : "Matrix"));
+        file << "        <Attribute Name=\"" << array.name << "\" AttributeType=\"" << type << "\" Center=\"" << center << "\">\n";
+        writeHyperSlab(array.name, rows, array.numberOfComponents);
+        file << "        </Attribute>\n";
+    };
+
+    file << "      <Grid Name=\"Step" << numberOfSteps - 1 << "\" GridType=\"Uniform\">\n"
+         << "        <Time Value=\"" << step.time << "\"/>\n"
+         << "        <Topology TopologyType=\"Mixed\" NumberOfElements=\"" << mesh.numberOfCells << "\">\n"
+         << "          <DataItem Dimensions=\"" << mesh.topologySize << "\" NumberType=\"Int\" Precision=\"4\" Format=\"HDF\">"
+         << group << "/Topology</DataItem>\n"
+         << "        </Topology>\n"
+         << "        <Geometry GeometryType=\"XYZ\">\n";
+    writeHyperSlab("Geometry", mesh.numberOfPoints, 3);
+    file << "        </Geometry>\n";
+    for (const Array &array : step.pointData)
+        writeAttribute(array, "Node", mesh.numberOfPoints);
+    for (const Array &array : step.cellData)
+        writeAttribute(array, "Cell", mesh.numberOfCells);
+    file << "      </Grid>\n";
+
+    indexTail_ = file.tellp();
+    file << "    </Grid>\n"
+         << "  </Domain>\n"
+         << "</Xdmf>\n";
+    file.close();
+}
+#endif
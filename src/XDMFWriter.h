@@ -0,0 +1,88 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <mpi.h>
+#include "VTUWriter.h"
+
+// Time series of the results in a single HDF5 file described by an XDMF index. Every mesh generation gets a group
+// with its topology, written once, and the datasets of the geometry and of the fields, which grow by one step
+// along their first dimension and are chunked one step per chunk, so reading a step is one hyperslab per array.
+// With parallel HDF5 every rank writes its own rows of the datasets, otherwise the pieces are gathered on rank 0.
+class XDMFWriter
+{
+public:
+    struct Array
+    {
+        std::string name;
+        int numberOfComponents;
+        std::vector<double> values;
+    };
+
+    // One output step, as seen by the rank that writes it: its rows and where they go in the global datasets
+    struct Step
+    {
+        double time;
+        int meshGeneration;
+        bool newMesh;
+        uint64_t numberOfPoints[2]; // local and global
+        uint64_t numberOfCells[2];
+        uint64_t topologySize[2];
+        uint64_t pointOffset;
+        uint64_t cellOffset;
+        uint64_t topologyOffset;
+        std::vector<int32_t> topology; // XDMF mixed topology, only filled in the first step of a mesh generation
+        std::vector<double> coordinates;
+        std::vector<Array> pointData;
+        std::vector<Array> cellData;
+    };
+
+    // The files are fileName.h5 and fileName.xmf; dimension is the one of the problem (2 or 3)
+    XDMFWriter(const std::string &fileName, MPI_Comm comm, const int &dimension);
+
+    ~XDMFWriter();
+
+    // Collective. Takes the arrays of the local piece (which is left empty) and detects a new mesh generation from
+    // the topology. Without parallel HDF5 the pieces are gathered on rank 0, whose step is the only one to write.
+    std::shared_ptr<Step> prepareStep(const double &time, VTUWriter &piece);
+
+    // Appends the step to the files. Collective with parallel HDF5, otherwise called by rank 0 only, which allows
+    // it to run on the output thread.
+    void writeStep(const Step &step);
+
+    // True when the ranks write their own rows (parallel HDF5 and more than one rank)
+    bool isParallel() const;
+
+private:
+    struct Mesh
+    {
+        int generation;
+        int numberOfSteps;
+        uint64_t numberOfPoints;
+        uint64_t numberOfCells;
+        uint64_t topologySize;
+    };
+
+    static std::vector<int32_t> buildTopology(const VTUWriter &piece, const uint64_t &pointOffset);
+
+    // Moves a DataArray into the arrays of the step, as one or more XDMF attributes
+    void takeArray(VTUWriter::DataArray &array, std::vector<Array> &arrays) const;
+
+    void writeIndex(const Step &step, const Mesh &mesh);
+
+    std::string fileName_;
+    MPI_Comm comm_;
+    int rank_;
+    int dimension_;
+    bool parallel_;
+
+    // used by prepareStep
+    int meshGeneration_;
+    std::vector<int32_t> lastTopology_;
+
+    // used by writeStep
+    bool fileCreated_;
+    std::vector<Mesh> meshes_;
+    long long indexTail_; // position of the closing tags of the .xmf
+};
@@ -39,4 +39,53 @@ enum ReferenceConfiguration
     INITIAL,
     PAST,
     CURRENT
+};
+
+enum class SolverProfile
+{
+    DEFAULT,         // the historical setup of each solver (FGMRES+LU transient, FGMRES+block Jacobi static, MUMPS staggered)
+    FGMRES_LU,       // prefix "fgmres_lu_"
+    FGMRES_BJACOBI,  // prefix "fgmres_bjacobi_"
+    FGMRES_JACOBI,   // prefix "fgmres_jacobi_"
+    DIRECT_SERIAL,   // PETSc LU, one rank only - prefix "direct_"
+    DIRECT_MUMPS,    // MUMPS LU - prefix "mumps_"
+    GAMG_CG,         // conjugate gradient with algebraic multigrid, compressible elasticity - prefix "gamg_"
+    FIELDSPLIT_SCHUR // Schur complement fieldsplit of the mixed position-pressure systems - prefix "schur_"
+};
+
+enum class Globalization
+{
+    FULL_STEP,      // plain Newton
+    BACKTRACKING,   // Armijo backtracking on the residual norm with quadratic interpolation
+    CRITICAL_POINT, // secant search for the zero of the energy directional derivative (the residual along the step)
+    TRUST_REGION    // Newton step clipped to a radius adapted from the actual/predicted residual reduction
+};
+
+enum class Predictor
+{
+    PREVIOUS_STEP,         // Newton starts from the converged configuration of the previous step
+    CONSTANT_VELOCITY,     // u(n) + dt v(n)
+    CONSTANT_ACCELERATION, // u(n) + dt v(n) + dt^2/2 a(n), the Newmark predictor
+    EXTRAPOLATION          // polynomial through the positions of the last converged steps
+};
+
+enum class ConvergenceCriterion
+{
+    POSITION_INCREMENT, // |du| / |x0| after the solve, with the nonlinear tolerance
+    ABSOLUTE_RESIDUAL,  // |R| checked before the solve
+    RELATIVE_RESIDUAL,  // |R| / |R0| with R0 the residual at the start of the step
+    ENERGY              // |du . R| / |du1 . R0|, the work of the last increment against the current residual
+};
+
+enum class VTUFormat
+{
+    ASCII,        // formatted text, one value at a time
+    APPENDED_RAW, // binary DataArrays appended after the XML, one bulk write each
+    APPENDED_ZLIB // appended binary compressed in blocks with zlib (raw when built without zlib)
+};
+
+enum class ResultsFormat
+{
+    VTU, // one .vtu per output step (a .pvtu and its pieces in parallel runs)
+    XDMF // single HDF5 file per run with the steps as hyperslabs, described by an .xmf index
 };
\ No newline at end of file